@@ -0,0 +1,329 @@
+/* Copyright 2021. Martin Uecker.
+ * All rights reserved. Use of this source code is governed by
+ * a BSD-style license which can be found in the LICENSE file.
+ * */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "type/type.h"
+#include "type/abi.h"
+#include "type/print.h"
+#include "type/stats.h"
+#include "type/trace.h"
+
+#include "gen.h"
+#include "perf.h"
+
+
+// Each phase runs over all types of a generated universe. Two
+// universes generated from the same seed give pairs of distinct
+// but structurally equal types for the comparisons.
+
+enum format { FORMAT_TEXT, FORMAT_CSV, FORMAT_JSON };
+
+struct bench {
+
+	enum format format;
+	const char* label;
+	struct perf* perf;
+	int phases;		// reported so far
+	double start;
+};
+
+// results are accumulated here so that no call is optimized out
+
+static volatile size_t sink;
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1.E9 + ts.tv_nsec;
+}
+
+static long peak_rss(void)
+{
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+
+	return ru.ru_maxrss;	// KiB
+}
+
+
+// totals over traced events
+
+static const char* event_names[TYPE_TRACE_NR] = {
+
+	[TYPE_TRACE_ALLOC] = "alloc",
+	[TYPE_TRACE_LAYOUT] = "layout",
+	[TYPE_TRACE_COMPATIBLE] = "compatible",
+	[TYPE_TRACE_PRINT] = "print",
+};
+
+struct trace {
+
+	long count[TYPE_TRACE_NR];
+	unsigned long long ns[TYPE_TRACE_NR];
+};
+
+static void trace_hook(void* ctx, enum type_trace_event event, enum type_kind kind, unsigned long long ns)
+{
+	struct trace* t = ctx;
+
+	(void)kind;
+
+	t->count[event]++;
+	t->ns[event] += ns;
+}
+
+static void trace_dump(FILE* fp, const struct trace* t)
+{
+	for (int i = 0; i < TYPE_TRACE_NR; i++)
+		if (0 < t->count[i])
+			fprintf(fp, "trace %-12s %10ld events %12.1f ns/event\n",
+				event_names[i], t->count[i], (double)t->ns[i] / t->count[i]);
+}
+
+
+static void begin(struct bench* b)
+{
+	perf_start(b->perf);
+	b->start = now();
+}
+
+static void end(struct bench* b, const char* name, long ops)
+{
+	double ns = now() - b->start;
+
+	bool valid[PERF_NR_COUNTERS];
+	double count[PERF_NR_COUNTERS];
+
+	perf_stop(b->perf, valid, count);
+
+	long rss = peak_rss();
+
+	switch (b->format) {
+
+	case FORMAT_TEXT:
+
+		printf("%-12s %10ld ops %12.1f ns/op %10ld KiB", name, ops, ns / ops, rss);
+
+		for (int i = 0; i < PERF_NR_COUNTERS; i++) {
+
+			if (valid[i])
+				printf(" %12.1f %s", count[i] / ops, perf_names[i]);
+			else
+				printf(" %12s %s", "-", perf_names[i]);
+		}
+
+		printf("\n");
+		break;
+
+	case FORMAT_CSV:
+
+		if (0 == b->phases) {
+
+			printf("label,phase,ops,ns_per_op,peak_rss_kib");
+
+			for (int i = 0; i < PERF_NR_COUNTERS; i++)
+				printf(",%s_per_op", perf_names[i]);
+
+			printf("\n");
+		}
+
+		printf("%s,%s,%ld,%.3f,%ld", b->label, name, ops, ns / ops, rss);
+
+		for (int i = 0; i < PERF_NR_COUNTERS; i++) {
+
+			if (valid[i])
+				printf(",%.3f", count[i] / ops);
+			else
+				printf(",");
+		}
+
+		printf("\n");
+		break;
+
+	case FORMAT_JSON:
+
+		printf("%s\n  { \"label\": \"%s\", \"phase\": \"%s\", \"ops\": %ld, \"ns_per_op\": %.3f, \"peak_rss_kib\": %ld",
+			(0 == b->phases) ? "[" : ",", b->label, name, ops, ns / ops, rss);
+
+		for (int i = 0; i < PERF_NR_COUNTERS; i++) {
+
+			if (valid[i])
+				printf(", \"%s_per_op\": %.3f", perf_names[i], count[i] / ops);
+			else
+				printf(", \"%s_per_op\": null", perf_names[i]);
+		}
+
+		printf(" }");
+		break;
+	}
+
+	b->phases++;
+}
+
+static void finish(struct bench* b)
+{
+	if ((FORMAT_JSON == b->format) && (0 < b->phases))
+		printf("\n]\n");
+}
+
+
+static long layout(const struct universe* u)
+{
+	long ops = 0;
+	size_t sum = 0;
+
+	for (int i = 0; i < u->N; i++) {
+
+		type t = u->types[i];
+
+		if (!type_struct_p(t) && !type_union_p(t))
+			continue;
+
+		sum += type_sizeof(t);
+		ops++;
+
+		int N = type_member_count(t);
+
+		for (int j = 0; j < N; j++)
+			sum += type_offsetof_n(t, j);
+
+		ops += N;
+	}
+
+	sink += sum;
+
+	return ops;
+}
+
+static long compare(const struct universe* a, const struct universe* b, bool (*cmp)(type a, type b))
+{
+	int n = 0;
+
+	for (int i = 0; i < a->N; i++)
+		n += cmp(a->types[i], b->types[i]);
+
+	sink += n;
+
+	return a->N;
+}
+
+static long print(const struct universe* u)
+{
+	static char buf[1 << 16];
+	long len = 0;
+
+	for (int i = 0; i < u->N; i++)
+		len += type_print(sizeof(buf), buf, u->types[i]);
+
+	sink += len;
+
+	return u->N;
+}
+
+
+int main(int argc, char* argv[])
+{
+	int N = 20000;
+	unsigned int seed = 1;
+	struct bench b = { FORMAT_TEXT, "", NULL, 0, 0. };
+	bool stats = false;
+	bool trace = false;
+	int c;
+
+	while (-1 != (c = getopt(argc, argv, "n:s:f:l:mt"))) {
+
+		switch (c) {
+
+		case 'n': N = atoi(optarg); break;
+		case 's': seed = atoi(optarg); break;
+		case 'l': b.label = optarg; break;
+		case 'm': stats = true; break;
+		case 't': trace = true; break;
+		case 'f':
+
+			if (0 == strcmp(optarg, "text"))
+				b.format = FORMAT_TEXT;
+			else if (0 == strcmp(optarg, "csv"))
+				b.format = FORMAT_CSV;
+			else if (0 == strcmp(optarg, "json"))
+				b.format = FORMAT_JSON;
+			else
+				goto usage;
+
+			break;
+
+		default:
+		usage:
+			fprintf(stderr, "usage: %s [-n types] [-s seed] [-f text|csv|json] [-l label] [-m] [-t]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (N <= 0)
+		return EXIT_FAILURE;
+
+	b.perf = perf_open();
+
+	struct trace events = { { 0 }, { 0 } };
+
+	if (trace)
+		type_trace(trace_hook, &events);
+
+	begin(&b);
+	struct universe* x = universe_generate(N, seed);
+	end(&b, "construct", N);
+
+	if (stats)
+		type_stats_dump(stderr);
+
+	struct universe* y = universe_generate(N, seed);
+	long ops;
+
+	begin(&b);
+	ops = layout(x);
+	end(&b, "layout", ops);
+
+	begin(&b);
+	ops = layout(x);
+	end(&b, "layout-warm", ops);
+
+	begin(&b);
+	ops = compare(x, y, type_compatible_p);
+	end(&b, "compatible", ops);
+
+	begin(&b);
+	ops = compare(x, y, type_identical_p);
+	end(&b, "identical", ops);
+
+	begin(&b);
+	ops = print(x);
+	end(&b, "print", ops);
+
+	universe_free(y);
+
+	begin(&b);
+	universe_free(x);
+	end(&b, "free", N);
+
+	finish(&b);
+	perf_close(b.perf);
+
+	if (trace) {
+
+		type_trace(NULL, NULL);
+		trace_dump(stderr, &events);
+	}
+
+	return EXIT_SUCCESS;
+}
+
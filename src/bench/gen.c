@@ -0,0 +1,224 @@
+/* Copyright 2021. Martin Uecker.
+ * All rights reserved. Use of this source code is governed by
+ * a BSD-style license which can be found in the LICENSE file.
+ * */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include "type/type.h"
+
+#include "gen.h"
+
+
+// The mix of types follows what is found in large C code bases:
+// mostly small structs, some embedding an earlier struct by value
+// (up to MAX_DEPTH levels), linked structures pointing to their
+// own tag, a few wide unions, and long prototypes. Generation
+// is deterministic for a given seed, so that two universes
+// generated with the same seed are structurally identical.
+
+enum { MAX_DEPTH = 32 };
+
+struct rng {
+
+	unsigned long long s;
+};
+
+static unsigned int next(struct rng* r)
+{
+	r->s ^= r->s << 13;
+	r->s ^= r->s >> 7;
+	r->s ^= r->s << 17;
+
+	return r->s >> 32;
+}
+
+static int range(struct rng* r, int lo, int hi)
+{
+	return lo + next(r) % (hi - lo + 1);
+}
+
+
+static void* xmalloc(size_t s)
+{
+	void* p = malloc(s);
+
+	if (NULL == p)
+		abort();
+
+	return p;
+}
+
+static type basic(struct rng* r)
+{
+	static const enum type_kind kinds[] = {
+
+		TYPE_CHAR, TYPE_SHORT, TYPE_INT, TYPE_LONG, TYPE_LONGLONG,
+		TYPE_FLOAT, TYPE_DOUBLE, TYPE_BOOL,
+	};
+
+	type t = type_basic(kinds[next(r) % (sizeof(kinds) / sizeof(kinds[0]))]);
+
+	if (type_integer_p(t) && (TYPE_BOOL != type_classify(t)) && (0 == next(r) % 3))
+		t = type_unsigned(t);
+
+	return t;
+}
+
+// a member of a struct or union, or an argument
+
+static type member(struct rng* r, struct universe* u, int depth[], int i, bool* embedded)
+{
+	int c = range(r, 0, 99);
+
+	if ((c < 10) && (0 < i) && !*embedded) {
+
+		// the previous type by value, so that chains of nested
+		// structs form
+
+		int j = i - 1;
+
+		if ((depth[j] < MAX_DEPTH) && (type_struct_p(u->types[j]) || type_union_p(u->types[j]))) {
+
+			*embedded = true;
+			depth[i] = depth[j] + 1;
+			return type_ref(u->types[j]);
+		}
+	}
+
+	if ((c < 40) && (0 < i))
+		return type_pointer(type_ref(u->types[next(r) % i]));
+
+	if (c < 50)
+		return type_array(range(r, 1, 16), basic(r));
+
+	if (c < 55)
+		return type_pointer(type_const(type_basic(TYPE_CHAR)));
+
+	return basic(r);
+}
+
+static type gen_struct(struct rng* r, struct universe* u, int depth[], int i)
+{
+	int N = range(r, 2, 16);
+	struct type_element e[N];
+	char names[N][16];
+	char tag[16];
+	bool embedded = false;
+
+	snprintf(tag, sizeof(tag), "s%d", i);
+
+	for (int j = 0; j < N; j++) {
+
+		snprintf(names[j], sizeof(names[j]), "m%d", j);
+
+		e[j].name = names[j];
+
+		if (0 == next(r) % 8)
+			e[j].typ = type_bitfield(type_unsigned(type_basic(TYPE_INT)), range(r, 1, 15));
+		else
+			e[j].typ = member(r, u, depth, i, &embedded);
+	}
+
+	u->members += N;
+
+	return type_struct(tag, N, e);
+}
+
+static type gen_list(struct rng* r, struct universe* u, int i)
+{
+	char tag[16];
+
+	snprintf(tag, sizeof(tag), "l%d", i);
+
+	struct type_element e[4] = {
+
+		{ "key", type_basic(TYPE_LONG) },
+		{ "next", type_pointer(type_struct_inc(tag)) },
+		{ "prev", type_pointer(type_struct_inc(tag)) },
+		{ "data", (0 < i) ? type_pointer(type_ref(u->types[next(r) % i])) : basic(r) },
+	};
+
+	u->members += 4;
+
+	return type_struct(tag, 4, e);
+}
+
+static type gen_union(struct rng* r, struct universe* u, int depth[], int i)
+{
+	int N = range(r, 32, 128);
+	struct type_element e[N];
+	char names[N][16];
+	char tag[16];
+	bool embedded = true;	// no nesting
+
+	snprintf(tag, sizeof(tag), "u%d", i);
+
+	for (int j = 0; j < N; j++) {
+
+		snprintf(names[j], sizeof(names[j]), "v%d", j);
+
+		e[j].name = names[j];
+		e[j].typ = member(r, u, depth, i, &embedded);
+	}
+
+	u->members += N;
+
+	return type_union(tag, N, e);
+}
+
+static type gen_function(struct rng* r, struct universe* u, int depth[], int i)
+{
+	int N = range(r, 16, 64);
+	type args[N];
+	bool embedded = true;
+
+	for (int j = 0; j < N; j++)
+		args[j] = member(r, u, depth, i, &embedded);
+
+	return type_function(basic(r), N, args);
+}
+
+
+struct universe* universe_generate(int N, unsigned int seed)
+{
+	struct universe* u = xmalloc(sizeof(struct universe));
+
+	u->N = N;
+	u->types = xmalloc(N * sizeof(type));
+	u->members = 0;
+
+	int* depth = xmalloc(N * sizeof(int));
+	struct rng r = { 0x9E3779B97F4A7C15ull ^ seed };
+
+	for (int i = 0; i < N; i++) {
+
+		depth[i] = 0;
+
+		int c = range(&r, 0, 99);
+
+		if (c < 75)
+			u->types[i] = gen_struct(&r, u, depth, i);
+		else if (c < 85)
+			u->types[i] = gen_list(&r, u, i);
+		else if (c < 92)
+			u->types[i] = gen_union(&r, u, depth, i);
+		else
+			u->types[i] = gen_function(&r, u, depth, i);
+	}
+
+	free(depth);
+
+	return u;
+}
+
+void universe_free(struct universe* u)
+{
+	type_free_n(u->N, u->types);
+
+	free(u->types);
+	free(u);
+}
+
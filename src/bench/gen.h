@@ -0,0 +1,17 @@
+
+struct type;
+
+// a synthetic type universe: structs, recursive lists, wide
+// unions, and function prototypes, each referring to earlier
+// types by value or through pointers
+
+struct universe {
+
+	int N;
+	const struct type** types;
+	int members;		// total over all compounds
+};
+
+extern struct universe* universe_generate(int N, unsigned int seed);
+extern void universe_free(struct universe* u);
+
@@ -0,0 +1,130 @@
+/* Copyright 2021. Martin Uecker.
+ * All rights reserved. Use of this source code is governed by
+ * a BSD-style license which can be found in the LICENSE file.
+ * */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "perf.h"
+
+
+// Each counter is opened on its own, so that a missing counter
+// does not disable the others. If the kernel multiplexes them,
+// counts are scaled by the time they were actually running.
+
+const char* perf_names[PERF_NR_COUNTERS] = {
+
+	[PERF_CYCLES] = "cycles",
+	[PERF_INSTRUCTIONS] = "instructions",
+	[PERF_CACHE_MISSES] = "cache_misses",
+	[PERF_BRANCH_MISSES] = "branch_misses",
+};
+
+struct perf {
+
+	int fd[PERF_NR_COUNTERS];
+};
+
+
+#ifdef __linux__
+static const unsigned long long config[PERF_NR_COUNTERS] = {
+
+	[PERF_CYCLES] = PERF_COUNT_HW_CPU_CYCLES,
+	[PERF_INSTRUCTIONS] = PERF_COUNT_HW_INSTRUCTIONS,
+	[PERF_CACHE_MISSES] = PERF_COUNT_HW_CACHE_MISSES,
+	[PERF_BRANCH_MISSES] = PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+static int open_counter(unsigned long long c)
+{
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = c;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+	return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+struct perf* perf_open(void)
+{
+	struct perf* p = malloc(sizeof(struct perf));
+
+	if (NULL == p)
+		abort();
+
+	for (int i = 0; i < PERF_NR_COUNTERS; i++) {
+#ifdef __linux__
+		p->fd[i] = open_counter(config[i]);
+#else
+		p->fd[i] = -1;
+#endif
+	}
+
+	return p;
+}
+
+void perf_close(struct perf* p)
+{
+	for (int i = 0; i < PERF_NR_COUNTERS; i++)
+		if (-1 != p->fd[i])
+			close(p->fd[i]);
+
+	free(p);
+}
+
+void perf_start(struct perf* p)
+{
+#ifdef __linux__
+	for (int i = 0; i < PERF_NR_COUNTERS; i++) {
+
+		if (-1 == p->fd[i])
+			continue;
+
+		ioctl(p->fd[i], PERF_EVENT_IOC_RESET, 0);
+		ioctl(p->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+	}
+#else
+	(void)p;
+#endif
+}
+
+void perf_stop(struct perf* p, bool valid[PERF_NR_COUNTERS], double count[PERF_NR_COUNTERS])
+{
+	for (int i = 0; i < PERF_NR_COUNTERS; i++) {
+
+		valid[i] = false;
+		count[i] = 0.;
+#ifdef __linux__
+		if (-1 == p->fd[i])
+			continue;
+
+		ioctl(p->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+
+		uint64_t v[3];	// value, time enabled, time running
+
+		if (   (sizeof(v) != read(p->fd[i], v, sizeof(v)))
+		    || (0 == v[2]))
+			continue;
+
+		valid[i] = true;
+		count[i] = (double)v[0] * v[1] / v[2];
+#endif
+	}
+}
+
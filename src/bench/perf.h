@@ -0,0 +1,19 @@
+
+#include <stdbool.h>
+
+// hardware counters (Linux perf events)
+
+enum perf_counter { PERF_CYCLES, PERF_INSTRUCTIONS, PERF_CACHE_MISSES, PERF_BRANCH_MISSES, PERF_NR_COUNTERS };
+
+extern const char* perf_names[PERF_NR_COUNTERS];
+
+struct perf;
+
+// counters which are not available are reported as missing,
+// all of them if perf events are not supported
+
+extern struct perf* perf_open(void);
+extern void perf_close(struct perf* p);
+extern void perf_start(struct perf* p);
+extern void perf_stop(struct perf* p, bool valid[PERF_NR_COUNTERS], double count[PERF_NR_COUNTERS]);
+
@@ -3,11 +3,16 @@
  * a BSD-style license which can be found in the LICENSE file.
  * */
 
+#include <stdlib.h>
 #include <assert.h>
 #include <string.h>
 #include <limits.h>
+#include <float.h>
+#include <pthread.h>
 
 #include "type.h"
+#include "cache.h"
+#include "trace.h"
 
 #include "abi.h"
 
@@ -16,51 +21,48 @@
 
 
 
-static size_t sizeof_union(type t)
+static void* xmalloc(size_t s)
 {
-	size_t max = 0;
-	int N = type_member_count(t);
+	void* p = malloc(s);
 
-	for (int i = 0; i < N; i++)
-		max = MAX(max, type_sizeof(type_member_type(t, i)));
+	if (NULL == p)
+		abort();
 
-	return max;
+	return p;
 }
 
-
-static size_t sizeof_struct(type t)
+static size_t round_up(size_t x, size_t a)
 {
-	int N = type_member_count(t);
-
-	assert(0 < N);
+	return (x + a - 1) / a * a;
+}
 
-	size_t off = type_offsetof_n(t, N - 1);
 
-	if (!type_struct_has_fam_p(t))
-		off += type_sizeof(type_member_type(t, N - 1));
+// members of packed structs only keep an explicit alignment
 
-	assert(0 < off);
+static size_t member_alignof(const struct abi* abi, type t, type e)
+{
+	if (!type_compound_packed_p(t))
+		return abi_alignof(abi, e);
 
-	return off;
+	return type_aligned_p(e) ? (size_t)type_aligned_bytes(e) : 1;
 }
 
-static size_t alignof_union(type t)
+static size_t alignof_union(const struct abi* abi, type t)
 {
-	size_t max = 0;
+	size_t max = MAX(1, type_compound_align(t));
 	int N = type_member_count(t);
 
 	for (int i = 0; i < N; i++)
-		max = MAX(max, type_alignof(type_member_type(t, i)));
+		max = MAX(max, member_alignof(abi, t, type_member_type(t, i)));
 
 	return max;
 }
 
 
-static size_t alignof_struct(type t)
-{
-	return alignof_union(t);
-}
+// arithmetic types are indexed by kind, signedness and domain
 
+#define ARITH_KINDS	10
+#define ARITH_NR	(4 * ARITH_KINDS)
 
 struct abi {
 
@@ -70,42 +72,508 @@ struct abi {
 		size_t alignment;
 
 	} table[TYPE_NR_KINDS];
+
+	bool big_endian;
+
+	enum abi_long_double long_double;
+
+	// enums use the smallest integer type which
+	// holds all values (-fshort-enums)
+
+	bool short_enums;
+
+	// vectors are aligned to their size up to
+	// this limit (if not zero)
+
+	size_t vector_align_max;
+
+	// bit-fields are allocated starting from the most
+	// significant bit of the storage unit
+
+	bool bitfield_msb_first;
+
+	// bit-fields (System V) may share storage units with
+	// fields of other types and are only moved to the next
+	// unit if they would straddle an aligned unit, or
+	// (Microsoft) occupy a unit of their declared type
+	// which is shared only with bit-fields of the same size
+
+	enum { BITFIELD_SYSV, BITFIELD_MS } bitfields;
+
+	// usual arithmetic conversions (tabulated on first use,
+	// the flag is set with release order after the tables)
+
+	bool arith_init;
+	type promotion[ARITH_NR];
+	type conversion[ARITH_NR][ARITH_NR];
 };
 
 #define TENTRY(x) { sizeof(x), _Alignof(x) }
-struct abi abi_host = { {
+struct abi abi_host = { .table = {
 	[TYPE_BOOL] = TENTRY(bool),
 	[TYPE_CHAR] = TENTRY(char),
 	[TYPE_SCHAR] = TENTRY(signed char),
-	[TYPE_SHORT] = TENTRY(signed int),
+	[TYPE_SHORT] = TENTRY(signed short),
 	[TYPE_INT] = TENTRY(signed int),
 	[TYPE_LONG] = TENTRY(long),
 	[TYPE_LONGLONG] = TENTRY(long long),
 	[TYPE_FLOAT] = TENTRY(float),
 	[TYPE_DOUBLE] = TENTRY(double),
+	[TYPE_LONGDOUBLE] = TENTRY(long double),
 	[TYPE_POINTER] = TENTRY(void*),
 	[TYPE_ENUM] = TENTRY(int),
-} };
+	},
+	.big_endian = (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__),
+#if LDBL_MANT_DIG == 64
+	.long_double = ABI_LDOUBLE_X87,
+#elif LDBL_MANT_DIG == 106
+	.long_double = ABI_LDOUBLE_IBM128,
+#elif LDBL_MANT_DIG == 113
+	.long_double = ABI_LDOUBLE_BINARY128,
+#endif
+	.bitfield_msb_first = (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__),
+#ifdef _WIN32
+	.bitfields = BITFIELD_MS,
+#else
+	.bitfields = BITFIELD_SYSV,
+#endif
+};
 
-static struct abi* abi = &abi_host;
+// System V i386
+
+struct abi abi_i386 = { .table = {
+	[TYPE_BOOL] = { 1, 1 },
+	[TYPE_CHAR] = { 1, 1 },
+	[TYPE_SCHAR] = { 1, 1 },
+	[TYPE_SHORT] = { 2, 2 },
+	[TYPE_INT] = { 4, 4 },
+	[TYPE_LONG] = { 4, 4 },
+	[TYPE_LONGLONG] = { 8, 4 },
+	[TYPE_FLOAT] = { 4, 4 },
+	[TYPE_DOUBLE] = { 8, 4 },
+	[TYPE_LONGDOUBLE] = { 12, 4 },
+	[TYPE_POINTER] = { 4, 4 },
+	[TYPE_ENUM] = { 4, 4 },
+	},
+	.big_endian = false,
+	.long_double = ABI_LDOUBLE_X87,
+};
 
-size_t type_sizeof(type t)
+// 32-bit ARM (AAPCS)
+
+struct abi abi_arm32 = { .table = {
+	[TYPE_BOOL] = { 1, 1 },
+	[TYPE_CHAR] = { 1, 1 },
+	[TYPE_SCHAR] = { 1, 1 },
+	[TYPE_SHORT] = { 2, 2 },
+	[TYPE_INT] = { 4, 4 },
+	[TYPE_LONG] = { 4, 4 },
+	[TYPE_LONGLONG] = { 8, 8 },
+	[TYPE_FLOAT] = { 4, 4 },
+	[TYPE_DOUBLE] = { 8, 8 },
+	[TYPE_LONGDOUBLE] = { 8, 8 },
+	[TYPE_POINTER] = { 4, 4 },
+	[TYPE_ENUM] = { 4, 4 },
+	},
+	.big_endian = false,
+	.vector_align_max = 8,
+};
+
+// bare-metal ARM (arm-none-eabi) uses short enums
+
+struct abi abi_arm_eabi = { .table = {
+	[TYPE_BOOL] = { 1, 1 },
+	[TYPE_CHAR] = { 1, 1 },
+	[TYPE_SCHAR] = { 1, 1 },
+	[TYPE_SHORT] = { 2, 2 },
+	[TYPE_INT] = { 4, 4 },
+	[TYPE_LONG] = { 4, 4 },
+	[TYPE_LONGLONG] = { 8, 8 },
+	[TYPE_FLOAT] = { 4, 4 },
+	[TYPE_DOUBLE] = { 8, 8 },
+	[TYPE_LONGDOUBLE] = { 8, 8 },
+	[TYPE_POINTER] = { 4, 4 },
+	[TYPE_ENUM] = { 4, 4 },
+	},
+	.big_endian = false,
+	.short_enums = true,
+	.vector_align_max = 8,
+};
+
+// Microsoft x64
+
+struct abi abi_ms64 = { .table = {
+	[TYPE_BOOL] = { 1, 1 },
+	[TYPE_CHAR] = { 1, 1 },
+	[TYPE_SCHAR] = { 1, 1 },
+	[TYPE_SHORT] = { 2, 2 },
+	[TYPE_INT] = { 4, 4 },
+	[TYPE_LONG] = { 4, 4 },
+	[TYPE_LONGLONG] = { 8, 8 },
+	[TYPE_FLOAT] = { 4, 4 },
+	[TYPE_DOUBLE] = { 8, 8 },
+	[TYPE_LONGDOUBLE] = { 8, 8 },
+	[TYPE_POINTER] = { 8, 8 },
+	[TYPE_ENUM] = { 4, 4 },
+	},
+	.big_endian = false,
+	.bitfields = BITFIELD_MS,
+};
+
+// 32-bit PowerPC (System V)
+
+struct abi abi_ppc32 = { .table = {
+	[TYPE_BOOL] = { 1, 1 },
+	[TYPE_CHAR] = { 1, 1 },
+	[TYPE_SCHAR] = { 1, 1 },
+	[TYPE_SHORT] = { 2, 2 },
+	[TYPE_INT] = { 4, 4 },
+	[TYPE_LONG] = { 4, 4 },
+	[TYPE_LONGLONG] = { 8, 8 },
+	[TYPE_FLOAT] = { 4, 4 },
+	[TYPE_DOUBLE] = { 8, 8 },
+	[TYPE_LONGDOUBLE] = { 16, 16 },
+	[TYPE_POINTER] = { 4, 4 },
+	[TYPE_ENUM] = { 4, 4 },
+	},
+	.big_endian = true,
+	.long_double = ABI_LDOUBLE_IBM128,
+	.bitfield_msb_first = true,
+};
+
+static struct abi* current = &abi_host;
+
+
+bool abi_big_endian_p(const struct abi* abi)
+{
+	return abi->big_endian;
+}
+
+enum abi_long_double abi_long_double(const struct abi* abi)
+{
+	return abi->long_double;
+}
+
+
+
+// The layout of a struct or union is computed in one pass and
+// cached in the node (per ABI). Bit-fields are allocated in
+// storage units of their declared type following the rules of
+// the ABI, zero-width bit-fields close the current unit. Bit
+// offsets count in allocation order. Bit-fields in packed structs
+// are allocated at the next free bit. An explicitly aligned
+// bit-field starts at its alignment (GCC).
+
+struct member_layout {
+
+	size_t offset;		// storage unit
+	size_t bitoff;		// first bit
+};
+
+struct layout {
+
+	const struct abi* abi;
+	struct layout* next;
+
+	size_t size;
+	size_t align;
+
+	struct member_layout m[];
+};
+
+static bool flexible_array_p(type t)
+{
+	return type_array_p(t) && !type_complete_p(t);
+}
+
+// layout of the first N members, returns the end in bits
+
+static size_t layout_members(const struct abi* abi, type t, int N, struct member_layout m[N], size_t* align)
+{
+	bool un = type_union_p(t);
+	bool packed = type_compound_packed_p(t);
+	size_t bit = 0;
+	size_t end = 0;
+
+	// open storage unit (Microsoft)
+
+	size_t unit_start = 0;
+	size_t unit_size = 0;
+
+	*align = MAX(1, type_compound_align(t));
+
+	for (int i = 0; i < N; i++) {
+
+		type e = type_member_type(t, i);
+		size_t al = member_alignof(abi, t, e);
+		size_t size = type_known_const_size_p(e) ? abi_sizeof(abi, e) : 0;
+
+		if (un)
+			bit = unit_size = 0;
+
+		if (type_bitfield_p(e) && (BITFIELD_MS == abi->bitfields)) {
+
+			size_t w = type_bitfield_bits(e);
+			size_t unit = size * CHAR_BIT;
+
+			if (0 == w) {
+
+				if (0 < unit_size)
+					bit = unit_start + unit_size;
+
+				unit_size = 0;
+				m[i] = (struct member_layout){ bit / CHAR_BIT, bit };
+				continue;
+			}
+
+			if ((unit_size != unit) || (unit_start + unit_size < bit + w)) {
+
+				if (0 < unit_size)
+					bit = unit_start + unit_size;
+
+				unit_start = bit = round_up(bit, al * CHAR_BIT);
+				unit_size = unit;
+			}
+
+			m[i] = (struct member_layout){ unit_start / CHAR_BIT, bit };
+			bit += w;
+
+			*align = MAX(*align, al);
+			end = MAX(end, unit_start + unit_size);
+			continue;
+		}
+
+		if (0 < unit_size) {
+
+			bit = unit_start + unit_size;
+			unit_size = 0;
+		}
+
+		if (type_bitfield_p(e)) {
+
+			size_t w = type_bitfield_bits(e);
+			size_t unit = al * CHAR_BIT;
+
+			if (type_aligned_p(e) && (0 < w)) {
+
+				bit = round_up(bit, al * CHAR_BIT);
+
+				if (!packed)
+					unit = abi_alignof(abi, type_base(e)) * CHAR_BIT;
+			}
+
+			if (0 == w) {
+
+				bit = round_up(bit, unit);
+				m[i] = (struct member_layout){ bit / CHAR_BIT, bit };
+				continue;
+			}
+
+			size_t start = bit / unit * unit;
+
+			if (!packed && (start + size * CHAR_BIT < bit + w))
+				start = bit = round_up(bit, unit);
+
+			m[i] = (struct member_layout){ start / CHAR_BIT, bit };
+			bit += w;
+
+		} else {
+
+			bit = round_up(bit, al * CHAR_BIT);
+			m[i] = (struct member_layout){ bit / CHAR_BIT, bit };
+			bit += size * CHAR_BIT;
+		}
+
+		*align = MAX(*align, al);
+		end = MAX(end, bit);
+	}
+
+	return end;
+}
+
+// all members have constant size (except for a flexible array member)
+
+static bool layout_const_p(type t)
+{
+	if (!type_complete_p(t))
+		return false;
+
+	int N = type_member_count(t);
+
+	for (int i = 0; i < N; i++) {
+
+		type e = type_member_type(t, i);
+
+		if (type_known_const_size_p(e))
+			continue;
+
+		if (   (i == N - 1) && flexible_array_p(e)
+		    && type_known_const_size_p(type_array_element(e)))
+			continue;
+
+		return false;
+	}
+
+	return true;
+}
+
+static struct layout* layout_find(const struct abi* abi, type t)
+{
+	for (struct layout* l = *type_layout_cache(t); NULL != l; l = l->next)
+		if (abi == l->abi)
+			return l;
+
+	return NULL;
+}
+
+// a layout is only cached if all members have constant size, so
+// the members are only scanned when none is cached for the ABI
+
+static const struct layout* layout(const struct abi* abi, type t)
+{
+	const struct layout* c = layout_find(abi, t);
+
+	if (NULL != c)
+		return c;
+
+	assert(layout_const_p(t));
+
+	struct layout** p = type_layout_cache(t);
+
+	unsigned long long start = TRACING() ? type_trace_clock() : 0;
+
+	int N = type_member_count(t);
+	struct layout* l = xmalloc(sizeof(struct layout) + N * sizeof(struct member_layout));
+
+	size_t end = layout_members(abi, t, N, l->m, &l->align);
+
+	l->size = round_up(round_up(end, CHAR_BIT) / CHAR_BIT, l->align);
+	l->abi = abi;
+	l->next = *p;
+	*p = l;
+
+	if (TRACING())
+		type_trace_event(TYPE_TRACE_LAYOUT, type_classify(t), start);
+
+	return l;
+}
+
+// the layout if all members have constant size, NULL otherwise
+
+static const struct layout* layout_const(const struct abi* abi, type t)
+{
+	const struct layout* l = layout_find(abi, t);
+
+	if ((NULL == l) && layout_const_p(t))
+		l = layout(abi, t);
+
+	return l;
+}
+
+void layout_free(struct layout* l)
+{
+	while (NULL != l) {
+
+		struct layout* n = l->next;
+		free(l);
+		l = n;
+	}
+}
+
+static struct member_layout member_layout(const struct abi* abi, type t, int n)
+{
+	assert(type_compound_p(t));
+	assert((0 <= n) && (n < type_member_count(t)));
+
+	const struct layout* l = layout_const(abi, t);
+
+	if (NULL != l)
+		return l->m[n];
+
+	// members following one with variable size have no constant offset
+
+	for (int i = 0; i < n; i++)
+		assert(type_known_const_size_p(type_member_type(t, i)));
+
+	struct member_layout m[n + 1];
+	size_t align;
+
+	layout_members(abi, t, n + 1, m, &align);
+
+	return m[n];
+}
+
+
+// _BitInt(N) has the size and alignment of the smallest standard
+// integer type which holds N bits, wider ones are arrays of limbs
+// with the alignment of long long
+
+static size_t bitint_layout(const struct abi* abi, int N, size_t* align)
+{
+	enum type_kind k[4] = { TYPE_CHAR, TYPE_SHORT, TYPE_INT, TYPE_LONGLONG };
+
+	for (int i = 0; i < 4; i++) {
+
+		if ((size_t)N <= abi->table[k[i]].size * CHAR_BIT) {
+
+			*align = abi->table[k[i]].alignment;
+			return abi->table[k[i]].size;
+		}
+	}
+
+	*align = abi->table[TYPE_LONGLONG].alignment;
+
+	return round_up((N + CHAR_BIT - 1) / CHAR_BIT, *align);
+}
+
+
+// The underlying type of an enum is unsigned int if there are no
+// negative values and int otherwise, or with short enums the first
+// of the character, short and int types which holds all values.
+// Incomplete enums are int.
+
+type abi_enum_underlying(const struct abi* abi, type t)
+{
+	assert(type_enum_p(t));
+
+	if (0 == type_member_count(t))
+		return type_basic(TYPE_INT);
+
+	int min = type_enum_min(t);
+	int max = type_enum_max(t);
+	bool uns = (0 <= min);
+
+	enum type_kind k[3] = { TYPE_SCHAR, TYPE_SHORT, TYPE_INT };
+
+	for (int i = abi->short_enums ? 0 : 2; i < 3; i++) {
+
+		int w = abi->table[k[i]].size * CHAR_BIT;
+
+		if (   (TYPE_INT == k[i])
+		    || ( uns && (max < (1 << w)))
+		    || (!uns && (min >= -(1 << (w - 1))) && (max < (1 << (w - 1)))))
+			return uns ? type_unsigned(type_basic(k[i])) : type_basic(k[i]);
+	}
+
+	assert(0);
+}
+
+
+size_t abi_sizeof(const struct abi* abi, type t)
 {
 	assert(type_known_const_size_p(t));
 
 	if (type_arithmetic_p(t) && type_complex_p(t))
-		return 2 * type_sizeof(type_real(t));
+		return 2 * abi_sizeof(abi, type_real(t));
 
 	switch (type_category(t)) {
 
 	case TC_UNION:
-		return sizeof_union(t);
-
 	case TC_STRUCT:
-		return sizeof_struct(t);
+		return layout(abi, t)->size;
 
 	case TC_ARRAY:
-		return type_array_length(t) * type_sizeof(type_array_element(t));
+		return type_array_length(t) * abi_sizeof(abi, type_array_element(t));
 
 	case TC_FUNCTION:
 		assert(0);
@@ -119,25 +587,46 @@ size_t type_sizeof(type t)
 		assert(0);	// FIXME: the horror
 		break;
 
+	case TC_VECTOR:
+		return type_vector_lanes(t) * abi_sizeof(abi, type_vector_element(t));
+
 	case TC_SELF:
+
+		if (type_bitint_p(t)) {
+
+			size_t align;
+			return bitint_layout(abi, type_bitint_width(t), &align);
+		}
+
+		if (type_enum_p(t))
+			return abi_sizeof(abi, abi_enum_underlying(abi, t));
+
 		return abi->table[type_classify(t)].size;
 	}
 
 	assert(0);
 }
 
-size_t type_alignof(type t)
+size_t abi_alignof(const struct abi* abi, type t)
 {
+	if (type_aligned_p(t))
+		return MAX((size_t)type_aligned_bytes(t), abi_alignof(abi, type_base(t)));
+
 	switch (type_category(t)) {
 
 	case TC_UNION:
-		return alignof_union(t);
+	case TC_STRUCT: {
 
-	case TC_STRUCT:
-		return alignof_struct(t);
+		const struct layout* l = layout_const(abi, t);
+
+		if (NULL != l)
+			return l->align;
+
+		return alignof_union(abi, t);
+	}
 
 	case TC_ARRAY:
-		return type_alignof(type_array_element(t));
+		return abi_alignof(abi, type_array_element(t));
 
 	case TC_FUNCTION:
 		assert(0);
@@ -149,57 +638,98 @@ size_t type_alignof(type t)
 		assert(0);	// FIXME: the horror
 		break;
 
+	case TC_VECTOR: {
+
+		size_t size = abi_sizeof(abi, t);
+
+		if ((0 < abi->vector_align_max) && (abi->vector_align_max < size))
+			return abi->vector_align_max;
+
+		return size;
+	}
+
 	case TC_SELF:
+
+		if (type_bitint_p(t)) {
+
+			size_t align;
+			bitint_layout(abi, type_bitint_width(t), &align);
+			return align;
+		}
+
+		if (type_enum_p(t))
+			return abi_alignof(abi, abi_enum_underlying(abi, t));
+
 		return abi->table[type_classify(t)].alignment;
 	}
 
 	assert(0);
 }
 
-size_t type_offsetof_n(type t, int n)
+size_t abi_offsetof_n(const struct abi* abi, type t, int n)
 {
-	assert(type_compound_p(t));
+	return member_layout(abi, t, n).offset;
+}
 
-	int N = type_member_count(t);
-	assert(n < N);
+size_t abi_bitoffsetof_n(const struct abi* abi, type t, int n)
+{
+	return member_layout(abi, t, n).bitoff;
+}
 
-	if (type_union_p(t))
-		return 0;
 
-	size_t sum = 0;
-	int bits = 0;
+void abi_bitfield_pos(const struct abi* abi, type t, int n, struct abi_bitfield_pos* pos)
+{
+	type e = type_member_type(t, n);
 
-	for (int i = 0; i < N; i++) {
+	assert(type_bitfield_p(e));
 
-		type m = type_member_type(t, i);
+	struct member_layout m = member_layout(abi, t, n);
 
-		if (type_bitfield_p(m)) {
+	pos->offset = m.offset;
+	pos->size = abi_sizeof(abi, e);
+	pos->width = type_bitfield_bits(e);
 
-			int nbits = type_bitfield_bits(m);
+	int q = m.bitoff - m.offset * CHAR_BIT;
 
-			if ((0 != nbits) && (bits >= nbits)) {
+	// a packed bit-field may cross its storage unit, it then uses
+	// the bytes it spans (at most eight, see type_struct2)
 
-				bits -= nbits;
-				continue;
-			}
+	if (q + pos->width > pos->size * CHAR_BIT) {
 
-			bits = type_sizeof(m) * CHAR_BIT;
-		}
+		pos->offset = m.bitoff / CHAR_BIT;
+		q = m.bitoff % CHAR_BIT;
+		pos->size = (q + pos->width + CHAR_BIT - 1) / CHAR_BIT;
 
-		size_t al = type_alignof(m);
-		size_t pad = (al - sum % al) % al;
+		assert(pos->size <= 8);
+	}
 
-		assert((i > 0) || (0 == pad));
+	pos->shift = abi->bitfield_msb_first ? (pos->size * CHAR_BIT - q - pos->width) : q;
+}
 
-		sum += pad;
 
-		if (i == n)
-			return sum;
+size_t type_sizeof(type t)
+{
+	return abi_sizeof(current, t);
+}
 
-		sum += type_sizeof(m);
-	}
+size_t type_alignof(type t)
+{
+	return abi_alignof(current, t);
+}
+
+size_t type_offsetof_n(type t, int n)
+{
+	return abi_offsetof_n(current, t, n);
+}
+
+size_t type_bitoffsetof_n(type t, int n)
+{
+	return abi_bitoffsetof_n(current, t, n);
+}
 
-	return sum;
+void type_bitfield_pos(type t, int n, struct abi_bitfield_pos* pos)
+{
+	abi_bitfield_pos(current, t, n, pos);
 }
 
 
@@ -230,6 +760,328 @@ size_t type_widthof(type t)
 	if (type_bitfield_p(t))
 		return type_bitfield_bits(t);
 
+	if (type_bitint_p(t))
+		return type_bitint_width(t);
+
 	return type_sizeof(t) * CHAR_BIT;
 }
 
+
+
+// 6.3.1.1 Integer promotion and 6.3.1.8 Usual arithmetic conversions
+//
+// The result only depends on the kind, signedness, and domain of the
+// operands and on the widths the ABI assigns to the integer types.
+// Both are tabulated once per ABI and map to canonical types, so that
+// nothing is allocated and the caller does not own the result.
+// Bit-precise integers are not promoted and are converted without
+// the tables.
+
+static const int arith_slot[TYPE_NR_KINDS] = {	// zero for non-arithmetic
+
+	[TYPE_BOOL] = 1,
+	[TYPE_CHAR] = 2,
+	[TYPE_SCHAR] = 3,
+	[TYPE_SHORT] = 4,
+	[TYPE_INT] = 5,
+	[TYPE_ENUM] = 5,	// int is the compatible type
+	[TYPE_LONG] = 6,
+	[TYPE_LONGLONG] = 7,
+	[TYPE_FLOAT] = 8,
+	[TYPE_DOUBLE] = 9,
+	[TYPE_LONGDOUBLE] = 10,
+};
+
+static const enum type_kind arith_kind[ARITH_KINDS] = {
+
+	TYPE_BOOL, TYPE_CHAR, TYPE_SCHAR, TYPE_SHORT, TYPE_INT,
+	TYPE_LONG, TYPE_LONGLONG, TYPE_FLOAT, TYPE_DOUBLE, TYPE_LONGDOUBLE,
+};
+
+static int arith_index(type t)
+{
+	int s = arith_slot[type_classify(t)];
+
+	assert(0 < s);
+
+	return 4 * (s - 1) + (type_unsigned_p(t) ? 1 : 0)
+			+ ((type_float_p(t) && type_complex_p(t)) ? 2 : 0);
+}
+
+static type arith_type(int i)
+{
+	type t = type_basic(arith_kind[i / 4]);
+
+	if (i & 1)
+		t = type_unsigned(t);
+
+	if (i & 2)
+		t = type_complex(t);
+
+	return t;
+}
+
+static bool arith_valid_p(int i)
+{
+	enum type_kind k = arith_kind[i / 4];
+
+	if ((i & 2) && !type_float_p(type_basic(k)))
+		return false;
+
+	if ((i & 1) && type_float_p(type_basic(k)))
+		return false;
+
+	return (i == arith_index(arith_type(i)));
+}
+
+static int width(const struct abi* abi, enum type_kind k)
+{
+	return (TYPE_BOOL == k) ? 1 : (int)(abi->table[k].size * CHAR_BIT);
+}
+
+static int bitwidth(const struct abi* abi, type t)
+{
+	return type_bitint_p(t) ? type_bitint_width(t) : width(abi, type_classify(t));
+}
+
+// 6.3.1.1 the rank is ordered by width, standard integer types
+// rank above bit-precise integers of the same width, and an enum
+// has the rank of its underlying type
+
+static int std_rank(enum type_kind k)
+{
+	switch (k) {
+
+	case TYPE_BOOL: return 1;
+	case TYPE_CHAR: return 2;
+	case TYPE_SCHAR: return 2;
+	case TYPE_SHORT: return 3;
+	case TYPE_INT: return 4;
+	case TYPE_LONG: return 5;
+	case TYPE_LONGLONG: return 6;
+
+	default: assert(0);
+	}
+}
+
+static int rank(const struct abi* abi, type t)
+{
+	if (type_enum_p(t))
+		t = abi_enum_underlying(abi, t);
+
+	if (type_bitint_p(t))
+		return type_bitint_width(t) << 4;
+
+	return (width(abi, type_classify(t)) << 4) | (8 + std_rank(type_classify(t)));
+}
+
+static type arith_promote(const struct abi* abi, type t)
+{
+	if (type_float_p(t) || type_bitint_p(t))
+		return t;
+
+	type INT = type_basic(TYPE_INT);
+
+	if (rank(abi, t) > rank(abi, INT))
+		return t;
+
+	// all values must be representable in int
+
+	int w = width(abi, type_classify(t));
+
+	if (   (w < width(abi, TYPE_INT))
+	    || ((w == width(abi, TYPE_INT)) && !type_unsigned_p(t)))
+		return INT;
+
+	return type_unsigned(INT);
+}
+
+// the canonical unqualified node of an arithmetic type, so that
+// conversions only see (and return) shared immortal nodes
+
+static type arith_canonical(type t)
+{
+	type c = type_bitint_p(t) ? type_bitint(type_bitint_width(t)) : type_basic(type_classify(t));
+
+	if (type_float_p(t))
+		return type_complex_p(t) ? type_complex(c) : c;
+
+	return type_unsigned_p(t) ? type_unsigned(c) : c;
+}
+
+static type arith_convert(const struct abi* abi, type a, type b)
+{
+	if (type_float_p(a) || type_float_p(b)) {
+
+		// the result is complex if one of the operands is
+
+		bool cplx = (   (type_float_p(a) && type_complex_p(a))
+			     || (type_float_p(b) && type_complex_p(b)));
+
+		enum type_kind T[3] = { TYPE_LONGDOUBLE, TYPE_DOUBLE, TYPE_FLOAT };
+
+		for (int i = 0; i < 3; i++)
+			if (   (T[i] == type_classify(a))
+			    || (T[i] == type_classify(b)))
+				return cplx ? type_complex(type_basic(T[i])) : type_basic(T[i]);
+
+		assert(0);
+	}
+
+	a = arith_promote(abi, a);
+	b = arith_promote(abi, b);
+
+	if (a == b)
+		return a;
+
+	if (type_signed_p(a) == type_signed_p(b))
+		return (rank(abi, a) >= rank(abi, b)) ? a : b;
+
+	if (type_signed_p(a)) {
+
+		type tmp = a;
+		a = b;
+		b = tmp;
+	}
+
+	// a is unsigned and b is signed
+
+	if (rank(abi, a) >= rank(abi, b))
+		return a;
+
+	// the signed type can represent all values only if it is wider
+
+	if (bitwidth(abi, b) > bitwidth(abi, a))
+		return b;
+
+	return type_unsigned(b);
+}
+
+static void arith_init(struct abi* abi)
+{
+	static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+	if (__atomic_load_n(&abi->arith_init, __ATOMIC_ACQUIRE))
+		return;
+
+	pthread_mutex_lock(&lock);
+
+	if (abi->arith_init) {
+
+		pthread_mutex_unlock(&lock);
+		return;
+	}
+
+	for (int i = 0; i < ARITH_NR; i++) {
+
+		if (!arith_valid_p(i))
+			continue;
+
+		abi->promotion[i] = arith_promote(abi, arith_type(i));
+
+		for (int j = 0; j < ARITH_NR; j++)
+			if (arith_valid_p(j))
+				abi->conversion[i][j] = arith_convert(abi, arith_type(i), arith_type(j));
+	}
+
+	__atomic_store_n(&abi->arith_init, true, __ATOMIC_RELEASE);
+
+	pthread_mutex_unlock(&lock);
+}
+
+
+int type_rank(type t)
+{
+	assert(type_integer_p(t));
+
+	return rank(current, t);
+}
+
+type type_enum_underlying(type t)
+{
+	return abi_enum_underlying(current, t);
+}
+
+type type_int_promotion(type x)
+{
+	assert(type_integer_p(x));
+
+	const struct abi* abi = current;
+
+	arith_init(current);
+
+	if (type_enum_p(x) && !type_bitfield_p(x))
+		x = abi_enum_underlying(abi, x);
+
+	if (type_bitint_p(x)) {
+
+		type b = type_bitint(type_bitint_width(x));
+
+		return type_unsigned_p(x) ? type_unsigned(b) : b;
+	}
+
+	if (type_bitfield_p(x)) {
+
+		// bit-fields promote according to their width
+
+		int w = type_bitfield_bits(x);
+		type INT = type_basic(TYPE_INT);
+
+		if (   (TYPE_BOOL == type_classify(x))
+		    || (w < width(abi, TYPE_INT))
+		    || ((w == width(abi, TYPE_INT)) && type_signed_p(x)))
+			return INT;
+
+		if (w == width(abi, TYPE_INT))
+			return type_unsigned(INT);
+	}
+
+	return abi->promotion[arith_index(x)];
+}
+
+
+// this determines the common type, which is complex
+// if one of the operands is complex (returns a new reference)
+
+type type_usual_conversion(type a, type b)
+{
+	if (type_vector_p(a) || type_vector_p(b)) {
+
+		// (GCC) a scalar operand is converted to the
+		// element type, two vectors must be compatible
+
+		assert(   !type_vector_p(a) || !type_vector_p(b)
+		       || type_compatible_p(a, b));
+
+		assert(type_vector_p(a) || type_arithmetic_p(a));
+		assert(type_vector_p(b) || type_arithmetic_p(b));
+
+		return type_ref(type_vector_p(a) ? a : b);
+	}
+
+	assert(type_arithmetic_p(a));
+	assert(type_arithmetic_p(b));
+
+	arith_init(current);
+
+	if (type_bitfield_p(a))
+		a = type_int_promotion(a);
+
+	if (type_bitfield_p(b))
+		b = type_int_promotion(b);
+
+	if (type_enum_p(a))
+		a = abi_enum_underlying(current, a);
+
+	if (type_enum_p(b))
+		b = abi_enum_underlying(current, b);
+
+	if (type_bitint_p(a) || type_bitint_p(b))
+		return arith_convert(current, arith_canonical(a), arith_canonical(b));
+
+	type r = current->conversion[arith_index(a)][arith_index(b)];
+
+	assert(NULL != r);
+
+	return r;
+}
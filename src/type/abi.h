@@ -1,4 +1,6 @@
 
+#include <stdbool.h>
+
 
 struct type;
 
@@ -6,5 +8,44 @@ extern size_t type_sizeof(const struct type* t);
 extern size_t type_alignof(const struct type* t);
 extern size_t type_offsetof(const struct type* t, const char* name);
 extern size_t type_offsetof_n(const struct type* t, int n);
+extern size_t type_bitoffsetof_n(const struct type* t, int n);
 extern size_t type_widthof(const struct type* t);
 
+// a bit-field is extracted by loading its storage unit
+// (in the byte order of the ABI) and shifting it right
+
+struct abi_bitfield_pos {
+
+	size_t offset;	// storage unit
+	int size;	// of the storage unit
+	int shift;
+	int width;
+};
+
+extern void type_bitfield_pos(const struct type* t, int n, struct abi_bitfield_pos* pos);
+
+
+struct abi;
+
+extern struct abi abi_host;
+extern struct abi abi_i386;
+extern struct abi abi_arm32;
+extern struct abi abi_arm_eabi;
+extern struct abi abi_ms64;
+extern struct abi abi_ppc32;
+
+extern size_t abi_sizeof(const struct abi* abi, const struct type* t);
+extern size_t abi_alignof(const struct abi* abi, const struct type* t);
+extern size_t abi_offsetof_n(const struct abi* abi, const struct type* t, int n);
+extern size_t abi_bitoffsetof_n(const struct abi* abi, const struct type* t, int n);
+extern void abi_bitfield_pos(const struct abi* abi, const struct type* t, int n, struct abi_bitfield_pos* pos);
+extern bool abi_big_endian_p(const struct abi* abi);
+
+// representation of long double (float and double are IEEE)
+
+enum abi_long_double { ABI_LDOUBLE_BINARY64, ABI_LDOUBLE_X87, ABI_LDOUBLE_IBM128, ABI_LDOUBLE_BINARY128 };
+
+extern enum abi_long_double abi_long_double(const struct abi* abi);
+extern const struct type* abi_enum_underlying(const struct abi* abi, const struct type* t);
+extern const struct type* type_enum_underlying(const struct type* t);
+
@@ -0,0 +1,42 @@
+
+struct type;
+struct layout;
+
+// caches attached to type nodes by other parts of the library
+
+extern struct layout** type_layout_cache(const struct type* t);
+extern void layout_free(struct layout* l);
+
+struct enum_index;
+
+extern struct enum_index** type_enum_cache(const struct type* t);
+extern void enum_index_free(struct enum_index* x);
+
+struct path_cache;
+
+extern struct path_cache** type_path_cache(const struct type* t);
+extern void path_cache_free(struct path_cache* c);
+
+struct type_value_plan;
+
+extern struct type_value_plan** type_value_cache(const struct type* t);
+
+// allocation statistics (stats.c, with TYPE_STATS)
+
+extern void type_stats_node(int kind, int n);
+extern void type_stats_bytes(int kind, int mem, long long bytes);
+
+
+// ownership checking (debug.c, with TYPE_DEBUG)
+
+extern void type_debug_alloc(const struct type* t, int kind);
+extern void type_debug_ref(const struct type* t, int delta);
+extern void type_debug_free(const struct type* t);
+
+// tracing (trace.c), events are only timed if enabled
+
+extern bool type_trace_on;
+extern unsigned long long type_trace_clock(void);
+extern void type_trace_event(int event, int kind, unsigned long long start);
+
+#define TRACING() __builtin_expect(__atomic_load_n(&type_trace_on, __ATOMIC_ACQUIRE), 0)
@@ -0,0 +1,271 @@
+/* Copyright 2021. Martin Uecker.
+ * All rights reserved. Use of this source code is governed by
+ * a BSD-style license which can be found in the LICENSE file.
+ * */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdio.h>
+
+#ifdef TYPE_DEBUG
+#include <pthread.h>
+#include <execinfo.h>
+#include <unistd.h>
+#endif
+
+#include "type.h"
+#include "cache.h"
+
+#include "debug.h"
+
+
+// Every node which can be freed gets a record with the call stack
+// of its allocation. Freed nodes are not returned to the allocator
+// at once but kept in a quarantine, so that a later reference or
+// free of the same node is caught and reported with both stacks.
+// Live nodes are reported at exit grouped by allocation site.
+
+#ifdef TYPE_DEBUG
+
+enum { MAX_FRAMES = 16, NR_BUCKETS = 1 << 16, QUARANTINE = 1 << 14 };
+
+struct record {
+
+	const struct type* node;
+	int kind;
+	bool freed;
+	int refs;		// calls to type_ref
+	int releases;		// and to type_free
+
+	int nalloc;
+	void* alloc_at[MAX_FRAMES];
+	int nfree;
+	void* free_at[MAX_FRAMES];
+
+	struct record* next;
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct record* buckets[NR_BUCKETS];
+static int live = 0;
+
+static struct record* quarantine[QUARANTINE];
+static int qpos = 0;
+
+
+static unsigned int hash(const void* p)
+{
+	uintptr_t x = (uintptr_t)p;
+
+	x ^= x >> 17;
+	x *= 0xed5ad4bbu;
+	x ^= x >> 11;
+
+	return x % NR_BUCKETS;
+}
+
+static struct record** lookup(const struct type* t)
+{
+	struct record** r = &buckets[hash(t)];
+
+	while ((NULL != *r) && ((*r)->node != t))
+		r = &(*r)->next;
+
+	return r;
+}
+
+static void report_stack(FILE* fp, int n, void* const frames[n])
+{
+	fflush(fp);
+	backtrace_symbols_fd(frames, n, fileno(fp));
+}
+
+static void fail(const char* what, const struct record* r)
+{
+	fprintf(stderr, "type: %s of node %p (kind %d)\n", what, (void*)r->node, r->kind);
+
+	void* frames[MAX_FRAMES];
+	int n = backtrace(frames, MAX_FRAMES);
+
+	fprintf(stderr, "at:\n");
+	report_stack(stderr, n, frames);
+
+	fprintf(stderr, "allocated at:\n");
+	report_stack(stderr, r->nalloc, r->alloc_at);
+
+	if (r->freed) {
+
+		fprintf(stderr, "freed at:\n");
+		report_stack(stderr, r->nfree, r->free_at);
+	}
+
+	abort();
+}
+
+static void report_at_exit(void)
+{
+	if (0 < live)
+		type_debug_report(stderr);
+}
+
+static void report_init(void)
+{
+	atexit(report_at_exit);
+}
+
+void type_debug_alloc(const struct type* t, int kind)
+{
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+	pthread_once(&once, report_init);
+
+	struct record* r = calloc(1, sizeof(struct record));
+
+	if (NULL == r)
+		abort();
+
+	r->node = t;
+	r->kind = kind;
+	r->nalloc = backtrace(r->alloc_at, MAX_FRAMES);
+
+	pthread_mutex_lock(&lock);
+
+	// a node still in quarantine cannot be reused
+
+	struct record** p = lookup(t);
+
+	if (NULL != *p)
+		fail("reallocation", *p);
+
+	*p = r;
+	live++;
+
+	pthread_mutex_unlock(&lock);
+}
+
+static struct record* find(const struct type* t, const char* op)
+{
+	struct record* r = *lookup(t);
+
+	if (NULL == r) {
+
+		fprintf(stderr, "type: %s of unknown node %p\n", op, (void*)t);
+		abort();
+	}
+
+	if (r->freed)
+		fail(op, r);
+
+	return r;
+}
+
+// a reference is taken (+1) or released (-1)
+
+void type_debug_ref(const struct type* t, int delta)
+{
+	pthread_mutex_lock(&lock);
+
+	struct record* r = find(t, (0 < delta) ? "reference" : "free");
+
+	if (0 < delta)
+		r->refs++;
+	else
+		r->releases++;
+
+	pthread_mutex_unlock(&lock);
+}
+
+void type_debug_free(const struct type* t)
+{
+	pthread_mutex_lock(&lock);
+
+	struct record* r = find(t, "free");
+
+	r->freed = true;
+	r->nfree = backtrace(r->free_at, MAX_FRAMES);
+	live--;
+
+	// evict the oldest node from the quarantine
+
+	struct record* old = quarantine[qpos];
+
+	quarantine[qpos] = r;
+	qpos = (qpos + 1) % QUARANTINE;
+
+	if (NULL != old) {
+
+		*lookup(old->node) = old->next;
+
+		free((void*)old->node);
+		free(old);
+	}
+
+	pthread_mutex_unlock(&lock);
+}
+
+
+static int cmp_site(const void* _a, const void* _b)
+{
+	const struct record* a = *(const struct record**)_a;
+	const struct record* b = *(const struct record**)_b;
+
+	if (a->nalloc != b->nalloc)
+		return a->nalloc - b->nalloc;
+
+	return memcmp(a->alloc_at, b->alloc_at, a->nalloc * sizeof(void*));
+}
+
+int type_debug_report(FILE* fp)
+{
+	pthread_mutex_lock(&lock);
+
+	int n = 0;
+	struct record** all = malloc((live + 1) * sizeof(struct record*));
+
+	if (NULL == all)
+		abort();
+
+	for (int i = 0; i < NR_BUCKETS; i++)
+		for (struct record* r = buckets[i]; NULL != r; r = r->next)
+			if (!r->freed)
+				all[n++] = r;
+
+	qsort(all, n, sizeof(struct record*), cmp_site);
+
+	if (0 < n)
+		fprintf(fp, "type: %d nodes not freed\n", n);
+
+	for (int i = 0, j; i < n; i = j) {
+
+		int refs = 0;
+		int releases = 0;
+
+		for (j = i; (j < n) && (0 == cmp_site(&all[i], &all[j])); j++) {
+
+			refs += all[j]->refs;
+			releases += all[j]->releases;
+		}
+
+		fprintf(fp, "\n%d nodes (kind %d, %d references taken, %d released) allocated at:\n",
+			j - i, all[i]->kind, refs, releases);
+		report_stack(fp, all[i]->nalloc, all[i]->alloc_at);
+	}
+
+	free(all);
+
+	pthread_mutex_unlock(&lock);
+
+	return n;
+}
+
+#else
+
+int type_debug_report(FILE* fp)
+{
+	(void)fp;
+	return -1;
+}
+
+#endif
+
@@ -0,0 +1,10 @@
+
+#include <stdio.h>
+
+// ownership checking (if built with TYPE_DEBUG)
+//
+// Returns the number of live nodes after printing them grouped
+// by allocation site, or -1 if checking is not enabled.
+
+extern int type_debug_report(FILE* fp);
+
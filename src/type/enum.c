@@ -0,0 +1,223 @@
+/* Copyright 2021. Martin Uecker.
+ * All rights reserved. Use of this source code is governed by
+ * a BSD-style license which can be found in the LICENSE file.
+ * */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "type.h"
+#include "cache.h"
+
+
+// Lookup structures for enums are built on first use and cached
+// in the node. Values map to the first member declared with this
+// value, using a direct table if the range of values is dense and
+// a sorted index otherwise. Names are found in a hash table with
+// open addressing.
+
+struct entry {
+
+	int value;
+	int member;
+};
+
+struct enum_index {
+
+	int min;
+	int max;
+
+	int* table;		// dense: member for value - min, or -1
+
+	int N;
+	struct entry* sorted;	// sparse
+
+	int size;
+	int* names;		// members by name, or -1
+};
+
+
+static void* xmalloc(size_t s)
+{
+	void* p = malloc(s);
+
+	if (NULL == p)
+		abort();
+
+	return p;
+}
+
+static unsigned int hash(const char* s)
+{
+	uint32_t h = 2166136261u;
+
+	while ('\0' != *s)
+		h = (h ^ (unsigned char)*s++) * 16777619u;
+
+	return h;
+}
+
+static int cmp_entry(const void* _a, const void* _b)
+{
+	const struct entry* a = _a;
+	const struct entry* b = _b;
+
+	if (a->value != b->value)
+		return (a->value < b->value) ? -1 : 1;
+
+	return (a->member < b->member) ? -1 : (a->member > b->member);
+}
+
+static const struct enum_index* enum_index(type t)
+{
+	assert(type_enum_p(t));
+
+	struct enum_index** p = type_enum_cache(t);
+
+	if (NULL != *p)
+		return *p;
+
+	int N = type_member_count(t);
+
+	assert(0 < N);
+
+	struct enum_index* x = xmalloc(sizeof(struct enum_index));
+
+	x->min = x->max = type_enum_value(t, 0);
+
+	for (int i = 1; i < N; i++) {
+
+		int v = type_enum_value(t, i);
+
+		if (v < x->min)
+			x->min = v;
+
+		if (v > x->max)
+			x->max = v;
+	}
+
+	x->table = NULL;
+	x->sorted = NULL;
+	x->N = N;
+
+	int64_t range = (int64_t)x->max - x->min + 1;
+
+	if (range <= 2 * (int64_t)N + 8) {
+
+		x->table = xmalloc(range * sizeof(int));
+
+		for (int64_t i = 0; i < range; i++)
+			x->table[i] = -1;
+
+		for (int i = N - 1; i >= 0; i--)
+			x->table[type_enum_value(t, i) - x->min] = i;
+
+	} else {
+
+		x->sorted = xmalloc(N * sizeof(struct entry));
+
+		for (int i = 0; i < N; i++)
+			x->sorted[i] = (struct entry){ type_enum_value(t, i), i };
+
+		qsort(x->sorted, N, sizeof(struct entry), cmp_entry);
+	}
+
+	x->size = 4;
+
+	while (x->size < 2 * N)
+		x->size *= 2;
+
+	x->names = xmalloc(x->size * sizeof(int));
+
+	for (int i = 0; i < x->size; i++)
+		x->names[i] = -1;
+
+	for (int i = 0; i < N; i++) {
+
+		unsigned int h = hash(type_member_name(t, i)) & (x->size - 1);
+
+		while (-1 != x->names[h])
+			h = (h + 1) & (x->size - 1);
+
+		x->names[h] = i;
+	}
+
+	*p = x;
+
+	return x;
+}
+
+void enum_index_free(struct enum_index* x)
+{
+	free(x->table);
+	free(x->sorted);
+	free(x->names);
+	free(x);
+}
+
+
+int type_enum_min(type t)
+{
+	return enum_index(t)->min;
+}
+
+int type_enum_max(type t)
+{
+	return enum_index(t)->max;
+}
+
+const char* type_enum_name(type t, int value)
+{
+	const struct enum_index* x = enum_index(t);
+
+	if ((value < x->min) || (value > x->max))
+		return NULL;
+
+	int m = -1;
+
+	if (NULL != x->table) {
+
+		m = x->table[value - x->min];
+
+	} else {
+
+		// first entry with this value
+
+		int lo = 0;
+		int hi = x->N;
+
+		while (lo < hi) {
+
+			int mid = lo + (hi - lo) / 2;
+
+			if (x->sorted[mid].value < value)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		if ((lo < x->N) && (value == x->sorted[lo].value))
+			m = x->sorted[lo].member;
+	}
+
+	return (-1 == m) ? NULL : type_member_name(t, m);
+}
+
+bool type_enum_lookup(type t, const char* name, int* value)
+{
+	const struct enum_index* x = enum_index(t);
+
+	for (unsigned int h = hash(name) & (x->size - 1); -1 != x->names[h]; h = (h + 1) & (x->size - 1)) {
+
+		if (0 == strcmp(name, type_member_name(t, x->names[h]))) {
+
+			*value = type_enum_value(t, x->names[h]);
+			return true;
+		}
+	}
+
+	return false;
+}
+
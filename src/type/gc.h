@@ -0,0 +1,20 @@
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct type;
+
+// tracing collection (if built with TYPE_GC, no-ops otherwise)
+//
+// Nodes not reachable from a root are freed regardless of their
+// reference counts. Roots are registered in addition to holding
+// a reference. Collection must not run concurrently with other
+// use of the library.
+
+extern void type_gc_root(const struct type* t);
+extern void type_gc_unroot(const struct type* t);
+
+extern void type_gc_start(void);		// marks
+extern bool type_gc_step(size_t budget);	// sweeps, true when done
+extern size_t type_gc_collect(void);		// returns nodes freed
+
@@ -0,0 +1,659 @@
+/* Copyright 2021. Martin Uecker.
+ * All rights reserved. Use of this source code is governed by
+ * a BSD-style license which can be found in the LICENSE file.
+ * */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <float.h>
+#include <assert.h>
+
+#include "type.h"
+#include "abi.h"
+
+#include "marshal.h"
+
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
+#define HOST_BIG (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+
+
+// A marshalling plan converts records of a type from the layout
+// of one ABI to that of another. It is a flat list of operations
+// on each record: zeroing of holes, copies of identical runs, byte
+// swaps, width changes, and bit-field moves. Adjacent operations
+// of the same kind are merged into runs when the plan is built.
+// Arrays of records are processed in blocks, one operation at a
+// time, so that the inner loops are simple and vectorizable.
+//
+// Integers wider than 64 bits (_BitInt) are converted byte by byte.
+// Floating-point values are converted through the host long double,
+// so a plan cannot be built if one side uses a long double format
+// which the host does not have (other than IBM double-double, which
+// is a pair of doubles).
+
+enum float_format { F_BINARY32, F_BINARY64, F_X87, F_IBM128, F_BINARY128 };
+
+enum op_code { OP_ZERO, OP_COPY, OP_SWAP, OP_INT, OP_FLOAT, OP_BITS };
+
+struct op {
+
+	enum op_code code;
+	bool sign;
+	int ssize;		// element size (storage unit for bit-fields)
+	int dsize;
+	size_t src;		// offset
+	size_t dst;
+	size_t count;		// number of consecutive elements
+
+	// bit-fields and wide integers
+
+	int width;
+	int sshift;
+	int dshift;
+};
+
+struct type_marshal {
+
+	size_t ssize;
+	size_t dsize;
+	bool sbig;
+	bool dbig;
+	enum float_format sld;	// long double
+	enum float_format dld;
+
+	int N;
+	struct op ops[];
+};
+
+
+static void* xrealloc(void* p, size_t s)
+{
+	p = realloc(p, s);
+
+	if (NULL == p)
+		abort();
+
+	return p;
+}
+
+
+
+struct builder {
+
+	const struct abi* from;
+	const struct abi* to;
+	bool unsupported;
+
+	int N;
+	int size;
+	struct op* ops;
+};
+
+static bool run_p(const struct op* p, const struct op* op)
+{
+	return (   (p->code == op->code) && (p->sign == op->sign)
+		&& (p->ssize == op->ssize) && (p->dsize == op->dsize)
+		&& (p->width == op->width)
+		&& (p->src + p->count * p->ssize == op->src)
+		&& (p->dst + p->count * p->dsize == op->dst));
+}
+
+static void emit(struct builder* b, struct op op)
+{
+	if (0 < b->N) {
+
+		struct op* p = &b->ops[b->N - 1];
+
+		if (   (OP_COPY == op.code) && (OP_COPY == p->code)
+		    && (p->src + p->ssize == op.src)
+		    && (p->dst + p->dsize == op.dst)) {
+
+			p->ssize += op.ssize;
+			p->dsize += op.dsize;
+			return;
+		}
+
+		if ((OP_COPY != op.code) && (OP_BITS != op.code) && run_p(p, &op)) {
+
+			p->count += op.count;
+			return;
+		}
+	}
+
+	if (b->N == b->size) {
+
+		b->size = (0 == b->size) ? 16 : 2 * b->size;
+		b->ops = xrealloc(b->ops, b->size * sizeof(struct op));
+	}
+
+	b->ops[b->N++] = op;
+}
+
+
+static enum float_format long_double_format(const struct abi* abi)
+{
+	switch (abi_long_double(abi)) {
+
+	case ABI_LDOUBLE_X87:
+		return F_X87;
+
+	case ABI_LDOUBLE_IBM128:
+		return F_IBM128;
+
+	case ABI_LDOUBLE_BINARY128:
+		return F_BINARY128;
+
+	default:
+		return F_BINARY64;
+	}
+}
+
+static enum float_format float_format(int size, enum float_format ld)
+{
+	return (4 == size) ? F_BINARY32 : (8 == size) ? F_BINARY64 : ld;
+}
+
+static bool float_supported_p(enum float_format f)
+{
+	switch (f) {
+
+	case F_X87:
+		return (64 == LDBL_MANT_DIG);
+
+	case F_BINARY128:
+		return (113 == LDBL_MANT_DIG);
+
+	default:
+		return true;
+	}
+}
+
+static void build_scalar(struct builder* b, type t, size_t src, size_t dst, size_t count)
+{
+	if (type_float_p(t) && type_complex_p(t)) {
+
+		t = type_real(t);
+		count *= 2;
+	}
+
+	int ss = abi_sizeof(b->from, t);
+	int ds = abi_sizeof(b->to, t);
+	bool swap = (abi_big_endian_p(b->from) != abi_big_endian_p(b->to));
+
+	if (type_float_p(t)) {
+
+		enum float_format sf = float_format(ss, long_double_format(b->from));
+		enum float_format df = float_format(ds, long_double_format(b->to));
+
+		if (!float_supported_p(sf) || !float_supported_p(df)) {
+
+			b->unsupported = true;
+			return;
+		}
+
+		// IEEE values can be swapped as a whole, the halves of a
+		// double-double are swapped on their own
+
+		enum op_code code = OP_FLOAT;
+
+		if ((sf == df) && (ss == ds) && !swap)
+			code = OP_COPY;
+		else if ((sf == df) && (ss == ds) && ((F_BINARY32 == sf) || (F_BINARY64 == sf)))
+			code = OP_SWAP;
+
+		if (OP_COPY == code)
+			emit(b, (struct op){ OP_COPY, .ssize = ss * count, .dsize = ds * count, .src = src, .dst = dst, .count = 1 });
+		else
+			emit(b, (struct op){ code, .ssize = ss, .dsize = ds, .src = src, .dst = dst, .count = count });
+
+		return;
+	}
+
+	if ((ss == ds) && ((1 == ss) || !swap)) {
+
+		emit(b, (struct op){ OP_COPY, .ssize = ss * count, .dsize = ds * count, .src = src, .dst = dst, .count = 1 });
+		return;
+	}
+
+	if (ss == ds) {
+
+		emit(b, (struct op){ OP_SWAP, .ssize = ss, .dsize = ds, .src = src, .dst = dst, .count = count });
+		return;
+	}
+
+	bool sign = type_signed_p(t) || (type_character_p(t) && (CHAR_MIN < 0))
+			|| (type_enum_p(t) && type_signed_p(type_enum_underlying(t)));
+
+	// only _BitInt is wider than 64 bits
+
+	int width = ((8 < ss) || (8 < ds)) ? type_bitint_width(t) : 0;
+
+	emit(b, (struct op){ OP_INT, sign, .ssize = ss, .dsize = ds, .src = src, .dst = dst, .count = count, .width = width });
+}
+
+static void build(struct builder* b, type t, size_t src, size_t dst)
+{
+	switch (type_classify(t)) {
+
+	case TYPE_STRUCT: {
+
+		int N = type_member_count(t);
+
+		for (int i = 0; i < N; i++) {
+
+			type m = type_member_type(t, i);
+
+			if (type_bitfield_p(m)) {
+
+				bool sign = type_signed_p(m) || (type_enum_p(m) && type_signed_p(type_enum_underlying(m)));
+
+				struct abi_bitfield_pos sp, dp;
+				abi_bitfield_pos(b->from, t, i, &sp);
+				abi_bitfield_pos(b->to, t, i, &dp);
+
+				emit(b, (struct op){ OP_BITS, sign, .ssize = sp.size, .dsize = dp.size,
+					.src = src + sp.offset, .dst = dst + dp.offset, .count = 1,
+					.width = sp.width, .sshift = sp.shift, .dshift = dp.shift });
+
+				continue;
+			}
+
+			build(b, m, src + abi_offsetof_n(b->from, t, i),
+				    dst + abi_offsetof_n(b->to, t, i));
+		}
+
+		break;
+	}
+
+	case TYPE_UNION:
+
+		// the active member is unknown, so unions are copied as bytes
+
+		emit(b, (struct op){ OP_COPY,
+			.ssize = MIN(abi_sizeof(b->from, t), abi_sizeof(b->to, t)),
+			.dsize = MIN(abi_sizeof(b->from, t), abi_sizeof(b->to, t)),
+			.src = src, .dst = dst, .count = 1 });
+
+		break;
+
+	case TYPE_ARRAY: {
+
+		type e = type_array_element(t);
+		int N = type_array_length(t);
+
+		if (type_scalar_p(e)) {
+
+			build_scalar(b, e, src, dst, N);
+			break;
+		}
+
+		size_t ss = abi_sizeof(b->from, e);
+		size_t ds = abi_sizeof(b->to, e);
+
+		for (int i = 0; i < N; i++)
+			build(b, e, src + i * ss, dst + i * ds);
+
+		break;
+	}
+
+	case TYPE_VECTOR:
+
+		build_scalar(b, type_vector_element(t), src, dst, type_vector_lanes(t));
+		break;
+
+	case TYPE_FUNCTION:
+	case TYPE_VOID:
+		assert(0);
+
+	default:
+		build_scalar(b, t, src, dst, 1);
+		break;
+	}
+}
+
+
+struct type_marshal* type_marshal_plan(const struct type* t, const struct abi* from, const struct abi* to)
+{
+	assert(type_known_const_size_p(t));
+
+	struct builder b = { from, to, false, 0, 0, NULL };
+
+	build(&b, t, 0, 0);
+
+	if (b.unsupported) {
+
+		free(b.ops);
+		return NULL;
+	}
+
+	// holes in the destination (padding and bits around
+	// bit-fields) are zeroed first
+
+	size_t dsize = abi_sizeof(to, t);
+	bool* covered = xrealloc(NULL, dsize);
+
+	memset(covered, 0, dsize);
+
+	for (int i = 0; i < b.N; i++) {
+
+		const struct op* op = &b.ops[i];
+
+		if (OP_BITS != op->code)
+			memset(covered + op->dst, 1, op->count * op->dsize);
+	}
+
+	int Z = 0;
+
+	for (size_t i = 0; i < dsize; i++)
+		if (!covered[i] && ((0 == i) || covered[i - 1]))
+			Z++;
+
+	struct type_marshal* p = xrealloc(NULL, sizeof(struct type_marshal) + (Z + b.N) * sizeof(struct op));
+
+	p->ssize = abi_sizeof(from, t);
+	p->dsize = dsize;
+	p->sbig = abi_big_endian_p(from);
+	p->dbig = abi_big_endian_p(to);
+	p->sld = long_double_format(from);
+	p->dld = long_double_format(to);
+	p->N = 0;
+
+	for (size_t i = 0; i < dsize; i++) {
+
+		if (covered[i])
+			continue;
+
+		if ((0 < i) && !covered[i - 1]) {
+
+			p->ops[p->N - 1].dsize++;
+			continue;
+		}
+
+		p->ops[p->N++] = (struct op){ OP_ZERO, .dsize = 1, .dst = i, .count = 1 };
+	}
+
+	memcpy(p->ops + p->N, b.ops, b.N * sizeof(struct op));
+	p->N += b.N;
+
+	free(b.ops);
+	free(covered);
+
+	return p;
+}
+
+void type_marshal_free(struct type_marshal* p)
+{
+	free(p);
+}
+
+
+
+#define BSWAP_LOOP(T, SWAP)						\
+	for (size_t i = 0; i < n; i++) {				\
+									\
+		T x;							\
+		memcpy(&x, s + i * sizeof(T), sizeof(T));		\
+		x = SWAP(x);						\
+		memcpy(d + i * sizeof(T), &x, sizeof(T));		\
+	}
+
+static void swap_run(char* d, const char* s, size_t n, int size)
+{
+	switch (size) {
+
+	case 2: BSWAP_LOOP(uint16_t, __builtin_bswap16); break;
+	case 4: BSWAP_LOOP(uint32_t, __builtin_bswap32); break;
+	case 8: BSWAP_LOOP(uint64_t, __builtin_bswap64); break;
+
+	default:
+
+		for (size_t i = 0; i < n; i++)
+			for (int j = 0; j < size; j++)
+				d[i * size + j] = s[i * size + size - 1 - j];
+	}
+}
+
+static uint64_t load_int(const char* s, int size, bool big, bool sign)
+{
+	uint64_t v = 0;
+
+	for (int i = 0; i < size; i++)
+		v |= (uint64_t)(unsigned char)s[big ? (size - 1 - i) : i] << (CHAR_BIT * i);
+
+	if (sign && (size < 8) && (v >> (CHAR_BIT * size - 1)))
+		v |= ~UINT64_C(0) << (CHAR_BIT * size);
+
+	return v;
+}
+
+static void store_int(char* d, int size, bool big, uint64_t v)
+{
+	for (int i = 0; i < size; i++)
+		d[big ? (size - 1 - i) : i] = (char)(v >> (CHAR_BIT * i));
+}
+
+// integers wider than 64 bits are converted byte by byte, the bits
+// above the width are extended from its top bit on the way
+
+#define BYTE(p, size, big, i) ((p)[(big) ? ((size) - 1 - (i)) : (i)])
+
+static void convert_wide(char* d, int dsize, bool dbig, const char* s, int ssize, bool sbig, int width, bool sign)
+{
+	int top = (width - 1) / CHAR_BIT;
+	int bit = (width - 1) % CHAR_BIT;
+
+	bool neg = sign && (((unsigned char)BYTE(s, ssize, sbig, top) >> bit) & 1);
+	unsigned char ext = neg ? UCHAR_MAX : 0;
+	unsigned char m = (UCHAR_MAX >> (CHAR_BIT - 1 - bit));
+
+	for (int i = 0; i < dsize; i++) {
+
+		unsigned char x = ext;
+
+		if (i < top)
+			x = BYTE(s, ssize, sbig, i);
+
+		if (i == top)
+			x = (BYTE(s, ssize, sbig, i) & m) | (ext & ~m);
+
+		BYTE(d, dsize, dbig, i) = (char)x;
+	}
+}
+
+// floating-point values in the byte order of each side
+
+static void load_bytes(void* x, const char* s, int size, bool big)
+{
+	for (int i = 0; i < size; i++)
+		((char*)x)[i] = s[(big == HOST_BIG) ? i : (size - 1 - i)];
+}
+
+static void store_bytes(char* d, const void* x, int size, bool big)
+{
+	for (int i = 0; i < size; i++)
+		d[(big == HOST_BIG) ? i : (size - 1 - i)] = ((const char*)x)[i];
+}
+
+static long double load_float(const char* s, int size, bool big, enum float_format f)
+{
+	switch (f) {
+
+	case F_BINARY32: { float v; load_bytes(&v, s, sizeof(v), big); return v; }
+	case F_BINARY64: { double v; load_bytes(&v, s, sizeof(v), big); return v; }
+
+	case F_IBM128: {
+
+		double hi, lo;
+		load_bytes(&hi, s, sizeof(hi), big);
+		load_bytes(&lo, s + sizeof(hi), sizeof(lo), big);
+		return (long double)hi + lo;
+	}
+
+	default: {
+
+		assert(float_supported_p(f) && (size <= (int)sizeof(long double)));
+		long double v = 0.;
+#if LDBL_MANT_DIG == 64
+		load_bytes(&v, s, 10, big);	// x87 extended precision (with padding)
+#else
+		load_bytes(&v, s, sizeof(v), big);
+#endif
+		return v;
+	}
+	}
+}
+
+static void store_float(char* d, int size, bool big, enum float_format f, long double v)
+{
+	memset(d, 0, size);
+
+	switch (f) {
+
+	case F_BINARY32: { float x = v; store_bytes(d, &x, sizeof(x), big); return; }
+	case F_BINARY64: { double x = v; store_bytes(d, &x, sizeof(x), big); return; }
+
+	case F_IBM128: {
+
+		double hi = v;
+		double lo = v - hi;
+		store_bytes(d, &hi, sizeof(hi), big);
+		store_bytes(d + sizeof(hi), &lo, sizeof(lo), big);
+		return;
+	}
+
+	default:
+
+		assert(float_supported_p(f) && (size <= (int)sizeof(long double)));
+#if LDBL_MANT_DIG == 64
+		store_bytes(d, &v, 10, big);
+#else
+		store_bytes(d, &v, sizeof(v), big);
+#endif
+		return;
+	}
+}
+
+// bit-fields are read-modify-write of the storage unit
+// in the byte order of each side
+
+static uint64_t mask(int width)
+{
+	return (64 == width) ? ~UINT64_C(0) : ((UINT64_C(1) << width) - 1);
+}
+
+static uint64_t load_bits(const char* s, int size, bool big, int shift, int width)
+{
+	return (load_int(s, size, big, false) >> shift) & mask(width);
+}
+
+static void store_bits(char* d, int size, bool big, int shift, int width, uint64_t v)
+{
+	uint64_t m = mask(width) << shift;
+	uint64_t u = load_int(d, size, big, false);
+
+	store_int(d, size, big, (u & ~m) | ((v << shift) & m));
+}
+
+
+static void apply(const struct type_marshal* p, const struct op* op, size_t n, char* d, const char* s)
+{
+	switch (op->code) {
+
+	case OP_ZERO:
+
+		for (size_t r = 0; r < n; r++)
+			memset(d + r * p->dsize + op->dst, 0, op->dsize);
+
+		break;
+
+	case OP_COPY:
+
+		for (size_t r = 0; r < n; r++)
+			memcpy(d + r * p->dsize + op->dst, s + r * p->ssize + op->src, op->ssize);
+
+		break;
+
+	case OP_SWAP:
+
+		// records which are a single run are swapped in one loop
+
+		if ((op->count * op->ssize == p->ssize) && (p->ssize == p->dsize)) {
+
+			swap_run(d, s, n * op->count, op->ssize);
+			break;
+		}
+
+		for (size_t r = 0; r < n; r++)
+			swap_run(d + r * p->dsize + op->dst, s + r * p->ssize + op->src, op->count, op->ssize);
+
+		break;
+
+	case OP_INT:
+
+		if (0 < op->width) {
+
+			for (size_t r = 0; r < n; r++)
+				for (size_t k = 0; k < op->count; k++)
+					convert_wide(d + r * p->dsize + op->dst + k * op->dsize, op->dsize, p->dbig,
+						s + r * p->ssize + op->src + k * op->ssize, op->ssize, p->sbig,
+						op->width, op->sign);
+
+			break;
+		}
+
+		for (size_t r = 0; r < n; r++)
+			for (size_t k = 0; k < op->count; k++)
+				store_int(d + r * p->dsize + op->dst + k * op->dsize, op->dsize, p->dbig,
+					load_int(s + r * p->ssize + op->src + k * op->ssize, op->ssize, p->sbig, op->sign));
+
+		break;
+
+	case OP_FLOAT:
+
+		for (size_t r = 0; r < n; r++)
+			for (size_t k = 0; k < op->count; k++)
+				store_float(d + r * p->dsize + op->dst + k * op->dsize, op->dsize, p->dbig,
+					float_format(op->dsize, p->dld),
+					load_float(s + r * p->ssize + op->src + k * op->ssize, op->ssize, p->sbig,
+						float_format(op->ssize, p->sld)));
+
+		break;
+
+	case OP_BITS:
+
+		for (size_t r = 0; r < n; r++)
+			store_bits(d + r * p->dsize + op->dst, op->dsize, p->dbig, op->dshift, op->width,
+				load_bits(s + r * p->ssize + op->src, op->ssize, p->sbig, op->sshift, op->width));
+
+		break;
+	}
+}
+
+
+void type_marshal(const struct type_marshal* p, size_t n, void* dst, const void* src)
+{
+	enum { BLOCK = 256 };
+
+	char* d = dst;
+	const char* s = src;
+
+	// identical layouts
+
+	if (   (1 == p->N) && (OP_COPY == p->ops[0].code)
+	    && (p->ops[0].ssize == (int)p->ssize) && (p->ssize == p->dsize)) {
+
+		memcpy(d, s, n * p->ssize);
+		return;
+	}
+
+	for (size_t i = 0; i < n; i += BLOCK) {
+
+		size_t nb = MIN((size_t)BLOCK, n - i);
+
+		for (int j = 0; j < p->N; j++)
+			apply(p, &p->ops[j], nb, d + i * p->dsize, s + i * p->ssize);
+	}
+}
+
@@ -0,0 +1,12 @@
+
+#include <stddef.h>
+
+struct type;
+struct abi;
+struct type_marshal;
+
+// returns NULL if a floating-point format cannot be converted on this host
+extern struct type_marshal* type_marshal_plan(const struct type* t, const struct abi* from, const struct abi* to);
+extern void type_marshal_free(struct type_marshal* p);
+extern void type_marshal(const struct type_marshal* p, size_t n, void* dst, const void* src);
+
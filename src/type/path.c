@@ -0,0 +1,268 @@
+/* Copyright 2021. Martin Uecker.
+ * All rights reserved. Use of this source code is governed by
+ * a BSD-style license which can be found in the LICENSE file.
+ * */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <ctype.h>
+
+#include "type.h"
+#include "abi.h"
+#include "cache.h"
+
+#include "path.h"
+
+
+static void* xmalloc(size_t s)
+{
+	void* p = malloc(s);
+
+	if (NULL == p)
+		abort();
+
+	return p;
+}
+
+
+// Resolved paths are cached in the outermost type node in an open
+// addressing table keyed by ABI and path. Only successful lookups
+// are cached, a path which fails might resolve after an incomplete
+// member is completed. Completion drops the cache of the node.
+
+struct path_entry {
+
+	const struct abi* abi;
+	const char* path;	// NULL if empty
+	uint32_t hash;
+	struct type_path r;
+};
+
+struct path_cache {
+
+	int size;		// power of two, at most half used
+	int used;
+	struct path_entry* slots;
+};
+
+static uint32_t hash(const struct abi* abi, const char* s)
+{
+	uint32_t h = 2166136261u ^ (uint32_t)(uintptr_t)abi;	// FNV-1a
+
+	for (; '\0' != *s; s++)
+		h = (h ^ (unsigned char)*s) * 16777619u;
+
+	return h;
+}
+
+static struct path_entry* lookup(const struct path_cache* c, const struct abi* abi, const char* path, uint32_t h)
+{
+	for (int i = h & (c->size - 1); ; i = (i + 1) & (c->size - 1)) {
+
+		struct path_entry* e = &c->slots[i];
+
+		if (   (NULL == e->path)
+		    || (   (h == e->hash) && (abi == e->abi)
+			&& (0 == strcmp(path, e->path))))
+			return e;
+	}
+}
+
+static void insert(struct path_cache* c, const struct path_entry* e);
+
+static void grow(struct path_cache* c)
+{
+	struct path_cache n = { (0 == c->size) ? 16 : 2 * c->size, 0, NULL };
+
+	n.slots = xmalloc(n.size * sizeof(struct path_entry));
+
+	for (int i = 0; i < n.size; i++)
+		n.slots[i].path = NULL;
+
+	for (int i = 0; i < c->size; i++)
+		if (NULL != c->slots[i].path)
+			insert(&n, &c->slots[i]);
+
+	free(c->slots);
+	*c = n;
+}
+
+static void insert(struct path_cache* c, const struct path_entry* e)
+{
+	if (2 * (c->used + 1) > c->size)
+		grow(c);
+
+	*lookup(c, e->abi, e->path, e->hash) = *e;
+	c->used++;
+}
+
+void path_cache_free(struct path_cache* c)
+{
+	for (int i = 0; i < c->size; i++)
+		free((char*)c->slots[i].path);
+
+	free(c->slots);
+	free(c);
+}
+
+
+// the member with this name or the unnamed structure or union which
+// contains it 6.7.2.1(15), unnamed bit-fields have no name either
+
+static int member_index(type t, int len, const char* name)
+{
+	int N = type_member_count(t);
+
+	for (int i = 0; i < N; i++) {
+
+		const char* m = type_member_name(t, i);
+
+		if (NULL == m) {
+
+			type e = type_member_type(t, i);
+
+			if (   type_compound_p(e) && type_complete_p(e)
+			    && (-1 != member_index(e, len, name)))
+				return i;
+
+			continue;
+		}
+
+		if ((0 == strncmp(m, name, len)) && ('\0' == m[len]))
+			return i;
+	}
+
+	return -1;
+}
+
+// each step adds to the offset of the current object, so that
+// only the last member may be a bit-field
+
+static bool resolve(const struct abi* abi, type t, const char* p, struct type_path* r)
+{
+	size_t offset = 0;
+	size_t bitoff = 0;
+	bool first = true;
+
+	while ('\0' != *p) {
+
+		if ('[' == *p) {
+
+			if (!type_array_p(t) || !isdigit((unsigned char)p[1]))
+				return false;
+
+			char* end;
+			unsigned long i = strtoul(p + 1, &end, 10);
+
+			if (']' != *end)
+				return false;
+
+			p = end + 1;
+
+			if (   type_complete_p(t) && !type_array_vla_p(t)
+			    && (i >= (unsigned long)type_array_length(t)))
+				return false;
+
+			t = type_array_element(t);
+
+			if (0 < i) {
+
+				if (!type_known_const_size_p(t))
+					return false;
+
+				offset += i * abi_sizeof(abi, t);
+			}
+
+			bitoff = offset * CHAR_BIT;
+
+		} else {
+
+			if (!first && ('.' != *p++))
+				return false;
+
+			int len = 0;
+
+			while (('_' == p[len]) || isalnum((unsigned char)p[len]))
+				len++;
+
+			if (   (0 == len) || isdigit((unsigned char)p[0])
+			    || !type_compound_p(t) || !type_complete_p(t))
+				return false;
+
+			// descends through unnamed members to the named one
+
+			const char* name;
+
+			do {
+				int n = member_index(t, len, p);
+
+				if (-1 == n)
+					return false;
+
+				if (type_struct_p(t))
+					for (int i = 0; i < n; i++)
+						if (!type_known_const_size_p(type_member_type(t, i)))
+							return false;
+
+				bitoff = offset * CHAR_BIT + abi_bitoffsetof_n(abi, t, n);
+				offset += abi_offsetof_n(abi, t, n);
+
+				name = type_member_name(t, n);
+				t = type_member_type(t, n);
+
+			} while (NULL == name);
+
+			p += len;
+		}
+
+		first = false;
+	}
+
+	if (first)
+		return false;
+
+	*r = (struct type_path){ offset, bitoff, t };
+
+	return true;
+}
+
+bool abi_path_resolve(const struct abi* abi, type t, const char* path, struct type_path* r)
+{
+	struct path_cache** c = type_path_cache(t);
+	uint32_t h = hash(abi, path);
+
+	if (NULL != *c) {
+
+		const struct path_entry* e = lookup(*c, abi, path, h);
+
+		if (NULL != e->path) {
+
+			*r = e->r;
+			return true;
+		}
+	}
+
+	if (!resolve(abi, t, path, r))
+		return false;
+
+	if (NULL == *c) {
+
+		*c = xmalloc(sizeof(struct path_cache));
+		**c = (struct path_cache){ 0, 0, NULL };
+	}
+
+	char* copy = xmalloc(strlen(path) + 1);
+	strcpy(copy, path);
+
+	insert(*c, &(struct path_entry){ abi, copy, h, *r });
+
+	return true;
+}
+
+bool type_path_resolve(type t, const char* path, struct type_path* r)
+{
+	return abi_path_resolve(&abi_host, t, path, r);
+}
+
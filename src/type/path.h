@@ -0,0 +1,23 @@
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct type;
+struct abi;
+
+// member designators as in offsetof, e.g. "hdr.fields[3].flags"
+//
+// Resolves a path through nested structs, unions and arrays. Fails
+// for unknown members, indices out of range, and members without a
+// constant offset. Results are cached in the outermost type.
+
+struct type_path {
+
+	size_t offset;			// bytes (storage unit for bit-fields)
+	size_t bitoff;			// first bit
+	const struct type* type;	// of the member, owned by the outermost type
+};
+
+extern bool type_path_resolve(const struct type* t, const char* path, struct type_path* r);
+extern bool abi_path_resolve(const struct abi* abi, const struct type* t, const char* path, struct type_path* r);
+
@@ -8,7 +8,10 @@
 #include <stdio.h>
 
 #include "type.h"
+#include "abi.h"
+#include "cache.h"
 #include "nested.h"
+#include "trace.h"
 
 #include "print.h"
 
@@ -79,6 +82,38 @@ static int p_basic(int n, char dst[static n], type t)
 
 typedef int CLOSURE_TYPE(p_inner_f)(int n, char dst[static n]);
 
+// compounds referenced through pointers are printed by tag only,
+// otherwise the output grows exponentially with the nesting. The
+// body of an untagged compound is printed unless it refers to itself.
+
+static _Thread_local int indirect = 0;
+
+struct open_compound {
+
+	type t;
+	const struct open_compound* next;
+};
+
+static _Thread_local const struct open_compound* printing = NULL;
+
+static bool p_body_p(type t)
+{
+	if (!type_complete_p(t))
+		return false;
+
+	if (0 == indirect)
+		return true;
+
+	if ('\0' != type_compound_tag(t)[0])
+		return false;
+
+	for (const struct open_compound* o = printing; NULL != o; o = o->next)
+		if (t == o->t)
+			return false;
+
+	return true;
+}
+
 static int p_type(int n, char dst[static n], type t, p_inner_f inner);
 
 #define CALL(fun, n, l, dst, ...) (l += fun((n - l), *(char(*)[MIN(n, l)])((dst) + MIN(n, l)), ## __VA_ARGS__))
@@ -118,6 +153,18 @@ static int p_array(int n, char dst[static n], type t, p_inner_f inner)
 	return l;
 }
 
+static int p_vector(int n, char dst[static n], type t)
+{
+	int l = 0;
+
+	CALL(p_type, n, l, dst, type_vector_element(t), NULL);
+	CALL(p_name, n, l, dst, " __attribute__((vector_size(");
+	CALL(p_number, n, l, dst, type_sizeof(t));
+	CALL(p_name, n, l, dst, ")))");
+
+	return l;
+}
+
 static int p_qualifiers(int n, char dst[static n], type t)
 {
 	int l = 0;
@@ -137,6 +184,13 @@ static int p_qualifiers(int n, char dst[static n], type t)
 	if (type_wide_p(t))
 		CALL(p_name, n, l, dst, "_Wide ");
 
+	if (type_aligned_p(t)) {
+
+		CALL(p_name, n, l, dst, "_Alignas(");
+		CALL(p_number, n, l, dst, type_aligned_bytes(t));
+		CALL(p_name, n, l, dst, ") ");
+	}
+
 	return l;
 }
 
@@ -145,7 +199,7 @@ static int p_pointer(int n, char dst[static n], type t, p_inner_f inner)
 	NESTED(int, p_pointer_inner, (int n, char dst[static n]))
 	{
 		int l = 0;
-		dst[l++] = '('; //?
+		CALL(p_char, n, l, dst, '('); //?
 		CALL(p_char, n, l, dst, '*');
 		
 		CALL(p_qualifiers, n, l, dst, t);
@@ -153,11 +207,17 @@ static int p_pointer(int n, char dst[static n], type t, p_inner_f inner)
 		if (NULL != inner)
 			CALL(inner, n, l, dst);
 
-		dst[l++] = ')';	//?
+		CALL(p_char, n, l, dst, ')');	//?
 		return l;
 	};
 
-	return p_type(n, dst, type_pointer_referenced(t), p_pointer_inner);
+	indirect++;
+
+	int l = p_type(n, dst, type_pointer_referenced(t), p_pointer_inner);
+
+	indirect--;
+
+	return l;
 }
 
 static int p_arglist(int n, char dst[static n], type t)
@@ -199,6 +259,9 @@ static int p_arglist(int n, char dst[static n], type t)
 static int p_compound(int n, char dst[static n], type t)
 {
 	int l = 0;
+	struct open_compound o = { t, printing };
+
+	printing = &o;
 
 	CALL(p_char, n, l, dst, '{');
 	CALL(p_char, n, l, dst, ' ');
@@ -231,19 +294,49 @@ static int p_compound(int n, char dst[static n], type t)
 
 	CALL(p_char, n, l, dst , '}');
 
+	printing = o.next;
+
 	return l;
 }
 
 
+static int p_attributes(int n, char dst[static n], type t)
+{
+	int l = 0;
+
+	if (!type_compound_packed_p(t) && (0 == type_compound_align(t)))
+		return l;
+
+	CALL(p_name, n, l, dst, " __attribute__((");
+
+	if (type_compound_packed_p(t))
+		CALL(p_name, n, l, dst, "packed");
+
+	if (type_compound_packed_p(t) && (0 < type_compound_align(t)))
+		CALL(p_name, n, l, dst, ", ");
+
+	if (0 < type_compound_align(t)) {
+
+		CALL(p_name, n, l, dst, "aligned(");
+		CALL(p_number, n, l, dst, type_compound_align(t));
+		CALL(p_char, n, l, dst, ')');
+	}
+
+	CALL(p_name, n, l, dst, "))");
+
+	return l;
+}
+
 static int p_struct(int n, char dst[static n], type t)
 {
 	int l = 0;
 
 	CALL(p_name, n, l, dst, "struct");
+	CALL(p_attributes, n, l, dst, t);
 	CALL(p_char, n, l, dst, ' ');
 	CALL(p_name, n, l, dst, type_compound_tag(t));
 
-	if (type_complete_p(t)) {
+	if (p_body_p(t)) {
 
 		CALL(p_char, n, l, dst, ' ');
 		CALL(p_compound, n, l, dst, t);
@@ -258,10 +351,11 @@ static int p_union(int n, char dst[static n], type t)
 	int l = 0;
 	
 	CALL(p_name, n, l, dst, "union");
+	CALL(p_attributes, n, l, dst, t);
 	CALL(p_char, n, l, dst, ' ');
 	CALL(p_name, n, l, dst, type_compound_tag(t));
 
-	if (type_complete_p(t)) {
+	if (p_body_p(t)) {
 
 		CALL(p_char, n, l, dst, ' ');
 		CALL(p_compound, n, l, dst, t);
@@ -319,7 +413,7 @@ static int p_function(int n, char dst[static n], type t, p_inner_f inner)
 			CALL(inner, n, l, dst);
 
 		CALL(p_char, n, l, dst, ')');
-		CALL(type_print, n, l, dst, type_function_arguments(t));
+		CALL(p_arglist, n, l, dst, type_function_arguments(t));
 
 		return l;
 	};
@@ -370,6 +464,20 @@ static int p_type(int n, char dst[static n], type t, p_inner_f inner)
 		CALL(p_enum, n, l, dst, t);
 		break; 
 
+	case TYPE_VECTOR:
+		CALL(p_vector, n, l, dst, t);
+		break;
+
+	case TYPE_BITINT:
+
+		if (type_unsigned_p(t))
+			CALL(p_name, n, l, dst, "unsigned ");
+
+		CALL(p_name, n, l, dst, "_BitInt(");
+		CALL(p_number, n, l, dst, type_bitint_width(t));
+		CALL(p_char, n, l, dst, ')');
+		break;
+
 	case TYPE_VOID:
 	case TYPE_BOOL:
 	case TYPE_CHAR:
@@ -417,11 +525,16 @@ static int p_type(int n, char dst[static n], type t, p_inner_f inner)
 
 int type_print(int n, char dst[static n], type t)
 {
+	unsigned long long start = TRACING() ? type_trace_clock() : 0;
+
 	int l = 0;
 
 	CALL(p_type, n, l, dst, t, NULL);
 	CALL(p_char, n, l, dst, '\0');
 
+	if (TRACING())
+		type_trace_event(TYPE_TRACE_PRINT, type_classify(t), start);
+
 	return l;
 }
 
@@ -437,10 +550,15 @@ int type_decl_print(int n, char dst[static n], const char* id, type t)
 		return l;
 	};
 
+	unsigned long long start = TRACING() ? type_trace_clock() : 0;
+
 	int l = 0;
 		
 	CALL(p_type, n, l, dst, t, inner);
-	CALL(p_char, n, l, dst + l, '\0');
+	CALL(p_char, n, l, dst, '\0');
+
+	if (TRACING())
+		type_trace_event(TYPE_TRACE_PRINT, type_classify(t), start);
 
 	return l;
 }
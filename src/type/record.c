@@ -0,0 +1,353 @@
+/* Copyright 2021. Martin Uecker.
+ * All rights reserved. Use of this source code is governed by
+ * a BSD-style license which can be found in the LICENSE file.
+ * */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <float.h>
+#include <assert.h>
+
+#include "type.h"
+#include "abi.h"
+
+#include "record.h"
+
+
+// Equality, hashing and copying of records (in the layout of
+// the host) are driven by a plan which only touches significant
+// bits. The plan is derived from a mask of all bits which belong
+// to a value, so padding, bits around bit-fields and the padding
+// of long double are ignored. Long runs of significant bytes are
+// compared and hashed with wide loads, everything else in words
+// of up to eight bytes under a mask. Copies zero the holes.
+// Pointers are compared and copied as addresses.
+
+enum op_code { OP_BYTES, OP_MASK, OP_ZERO };
+
+struct op {
+
+	enum op_code code;
+	int size;
+	size_t offset;
+	uint64_t mask;
+};
+
+struct type_record {
+
+	size_t size;
+	int N;
+	struct op ops[];
+};
+
+
+static void* xmalloc(size_t s)
+{
+	void* p = malloc(s);
+
+	if (NULL == p)
+		abort();
+
+	return p;
+}
+
+
+static void mark(unsigned char* m, type t, size_t offset)
+{
+	const struct abi* abi = &abi_host;
+
+	switch (type_classify(t)) {
+
+	case TYPE_STRUCT:
+	case TYPE_UNION: {
+
+		// the active member of a union is unknown,
+		// so all bits of any member are significant
+
+		int N = type_member_count(t);
+
+		for (int i = 0; i < N; i++) {
+
+			type e = type_member_type(t, i);
+
+			if (!type_bitfield_p(e)) {
+
+				mark(m, e, offset + abi_offsetof_n(abi, t, i));
+				continue;
+			}
+
+			struct abi_bitfield_pos pos;
+			abi_bitfield_pos(abi, t, i, &pos);
+
+			for (int j = pos.shift; j < pos.shift + pos.width; j++) {
+
+				int k = j / CHAR_BIT;
+
+				if (abi_big_endian_p(abi))
+					k = pos.size - 1 - k;
+
+				m[offset + pos.offset + k] |= 1u << (j % CHAR_BIT);
+			}
+		}
+
+		break;
+	}
+
+	case TYPE_ARRAY: {
+
+		type e = type_array_element(t);
+		size_t size = abi_sizeof(abi, e);
+		int N = type_array_length(t);
+
+		if (0 == N)
+			break;
+
+		mark(m, e, offset);
+
+		for (int i = 1; i < N; i++)
+			memcpy(m + offset + i * size, m + offset, size);
+
+		break;
+	}
+
+	default:
+
+		if (type_float_p(t) && type_complex_p(t)) {
+
+			type r = type_real(t);
+
+			mark(m, r, offset);
+			mark(m, r, offset + abi_sizeof(abi, r));
+			break;
+		}
+		// padding bits of bit-precise integers
+
+		if (type_bitint_p(t) && !abi_big_endian_p(abi)) {
+
+			int N = type_bitint_width(t);
+
+			memset(m + offset, 0xFF, N / CHAR_BIT);
+
+			if (0 != N % CHAR_BIT)
+				m[offset + N / CHAR_BIT] |= (1u << (N % CHAR_BIT)) - 1;
+
+			break;
+		}
+#if LDBL_MANT_DIG == 64
+		// x87 extended precision (with padding)
+
+		if (TYPE_LONGDOUBLE == type_classify(t)) {
+
+			memset(m + offset, 0xFF, 10);
+			break;
+		}
+#endif
+		memset(m + offset, 0xFF, abi_sizeof(abi, t));
+		break;
+	}
+}
+
+
+static size_t run(const unsigned char* m, size_t i, size_t n, unsigned char v)
+{
+	size_t j = i;
+
+	while ((j < n) && (v == m[j]))
+		j++;
+
+	return j - i;
+}
+
+struct type_record* type_record_plan(const struct type* t)
+{
+	assert(type_known_const_size_p(t));
+
+	size_t n = type_sizeof(t);
+	unsigned char* m = xmalloc(n + 1);
+
+	memset(m, 0, n);
+	mark(m, t, 0);
+
+	// at most one operation per byte
+
+	struct type_record* p = xmalloc(sizeof(struct type_record) + n * sizeof(struct op));
+
+	p->size = n;
+	p->N = 0;
+
+	for (size_t i = 0; i < n; ) {
+
+		size_t z = run(m, i, n, 0);
+
+		if (0 < z) {
+
+			p->ops[p->N++] = (struct op){ OP_ZERO, z, i, 0 };
+			i += z;
+			continue;
+		}
+
+		size_t f = run(m, i, n, 0xFF);
+
+		if (8 <= f) {
+
+			p->ops[p->N++] = (struct op){ OP_BYTES, f, i, 0 };
+			i += f;
+			continue;
+		}
+
+		// a masked word ends before a long run
+
+		size_t k = 0;
+
+		while ((k < 8) && (i + k < n) && (run(m, i + k, n, 0xFF) < 8))
+			k++;
+
+		while (0 == m[i + k - 1])
+			k--;
+
+		uint64_t mask = 0;
+		memcpy(&mask, m + i, k);
+
+		p->ops[p->N++] = (struct op){ OP_MASK, k, i, mask };
+		i += k;
+	}
+
+	free(m);
+
+	return p;
+}
+
+void type_record_free(struct type_record* p)
+{
+	free(p);
+}
+
+
+
+static uint64_t load(const char* p, int size)
+{
+	uint64_t v = 0;
+	memcpy(&v, p, size);
+	return v;
+}
+
+static uint64_t mix(uint64_t h, uint64_t v)
+{
+	h ^= v;
+	h *= UINT64_C(0x9E3779B97F4A7C15);
+	return h ^ (h >> 29);
+}
+
+
+bool type_record_equal(const struct type_record* p, const void* _a, const void* _b)
+{
+	const char* a = _a;
+	const char* b = _b;
+
+	for (int i = 0; i < p->N; i++) {
+
+		const struct op* op = &p->ops[i];
+
+		switch (op->code) {
+
+		case OP_BYTES:
+
+			if (0 != memcmp(a + op->offset, b + op->offset, op->size))
+				return false;
+
+			break;
+
+		case OP_MASK:
+
+			if (0 != ((load(a + op->offset, op->size) ^ load(b + op->offset, op->size)) & op->mask))
+				return false;
+
+			break;
+
+		case OP_ZERO:
+			break;
+		}
+	}
+
+	return true;
+}
+
+uint64_t type_record_hash(const struct type_record* p, const void* _a, uint64_t seed)
+{
+	const char* a = _a;
+	uint64_t h = mix(seed, p->size);
+
+	for (int i = 0; i < p->N; i++) {
+
+		const struct op* op = &p->ops[i];
+		const char* s = a + op->offset;
+
+		switch (op->code) {
+
+		case OP_BYTES: {
+
+			int j = 0;
+
+			for (; j + 8 <= op->size; j += 8)
+				h = mix(h, load(s + j, 8));
+
+			if (j < op->size)
+				h = mix(h, load(s + j, op->size - j));
+
+			break;
+		}
+
+		case OP_MASK:
+
+			h = mix(h, load(s, op->size) & op->mask);
+			break;
+
+		case OP_ZERO:
+			break;
+		}
+	}
+
+	return mix(h, 0);
+}
+
+void type_record_copy(const struct type_record* p, void* _d, const void* _s)
+{
+	char* d = _d;
+	const char* s = _s;
+
+	// a record without holes is one run
+
+	if ((1 == p->N) && (OP_BYTES == p->ops[0].code)) {
+
+		memcpy(d, s, p->size);
+		return;
+	}
+
+	for (int i = 0; i < p->N; i++) {
+
+		const struct op* op = &p->ops[i];
+
+		switch (op->code) {
+
+		case OP_BYTES:
+
+			memcpy(d + op->offset, s + op->offset, op->size);
+			break;
+
+		case OP_MASK: {
+
+			uint64_t v = load(s + op->offset, op->size) & op->mask;
+			memcpy(d + op->offset, &v, op->size);
+			break;
+		}
+
+		case OP_ZERO:
+
+			memset(d + op->offset, 0, op->size);
+			break;
+		}
+	}
+}
+
@@ -0,0 +1,14 @@
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+struct type;
+struct type_record;
+
+extern struct type_record* type_record_plan(const struct type* t);
+extern void type_record_free(struct type_record* p);
+extern bool type_record_equal(const struct type_record* p, const void* a, const void* b);
+extern uint64_t type_record_hash(const struct type_record* p, const void* a, uint64_t seed);
+extern void type_record_copy(const struct type_record* p, void* dst, const void* src);
+
@@ -0,0 +1,350 @@
+/* Copyright 2021. Martin Uecker.
+ * All rights reserved. Use of this source code is governed by
+ * a BSD-style license which can be found in the LICENSE file.
+ * */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "type.h"
+
+#include "scope.h"
+
+
+static void* xrealloc(void* p, size_t s)
+{
+	p = realloc(p, s);
+
+	if (NULL == p)
+		abort();
+
+	return p;
+}
+
+
+// Names are interned in an open addressing table of symbols, which
+// are never removed. Each symbol points to its innermost binding in
+// both name spaces. Bindings are kept on a stack which doubles as
+// the undo log: a binding records the one it shadows, and leaving a
+// scope pops the bindings made since it was entered and restores
+// the shadowed ones.
+
+enum ns { NS_TAG, NS_ORDINARY, NS_NR };
+
+struct symbol {
+
+	const char* name;
+	uint32_t hash;
+	int binding[NS_NR];	// innermost, -1 if none
+};
+
+struct binding {
+
+	type t;			// NULL for an identifier hiding a typedef
+	int symbol;
+	enum ns ns;
+	int shadowed;
+};
+
+struct type_scope {
+
+	int size;		// power of two, at most half used
+	int* slots;		// symbol index, -1 if empty
+
+	int nsymbols;
+	int max_symbols;
+	struct symbol* symbols;
+
+	int nbindings;
+	int max_bindings;
+	struct binding* bindings;
+
+	int depth;
+	int max_depth;
+	int* marks;		// number of bindings when entering a scope
+};
+
+
+static uint32_t hash(const char* s)
+{
+	uint32_t h = 2166136261u;	// FNV-1a
+
+	for (; '\0' != *s; s++)
+		h = (h ^ (unsigned char)*s) * 16777619u;
+
+	return h;
+}
+
+static int* slot(int* slots, int size, const struct symbol* symbols, const char* name, uint32_t h)
+{
+	for (int i = h & (size - 1); ; i = (i + 1) & (size - 1))
+		if (   (-1 == slots[i])
+		    || (   (h == symbols[slots[i]].hash)
+			&& (0 == strcmp(name, symbols[slots[i]].name))))
+			return &slots[i];
+}
+
+static void rehash(struct type_scope* s)
+{
+	int size = (0 == s->size) ? 64 : 2 * s->size;
+	int* slots = xrealloc(NULL, size * sizeof(int));
+
+	for (int i = 0; i < size; i++)
+		slots[i] = -1;
+
+	for (int i = 0; i < s->nsymbols; i++) {
+
+		const struct symbol* y = &s->symbols[i];
+		*slot(slots, size, s->symbols, y->name, y->hash) = i;
+	}
+
+	free(s->slots);
+
+	s->slots = slots;
+	s->size = size;
+}
+
+static const struct symbol* find(const struct type_scope* s, const char* name)
+{
+	if (0 == s->size)
+		return NULL;
+
+	int i = *slot(s->slots, s->size, s->symbols, name, hash(name));
+
+	return (-1 == i) ? NULL : &s->symbols[i];
+}
+
+static int intern(struct type_scope* s, const char* name)
+{
+	if (2 * (s->nsymbols + 1) > s->size)
+		rehash(s);
+
+	uint32_t h = hash(name);
+	int* p = slot(s->slots, s->size, s->symbols, name, h);
+
+	if (-1 != *p)
+		return *p;
+
+	if (s->nsymbols == s->max_symbols) {
+
+		s->max_symbols = (0 == s->max_symbols) ? 64 : 2 * s->max_symbols;
+		s->symbols = xrealloc(s->symbols, s->max_symbols * sizeof(struct symbol));
+	}
+
+	char* copy = xrealloc(NULL, strlen(name) + 1);
+	strcpy(copy, name);
+
+	s->symbols[s->nsymbols] = (struct symbol){ copy, h, { -1, -1 } };
+	*p = s->nsymbols;
+
+	return s->nsymbols++;
+}
+
+
+struct type_scope* type_scope_create(void)
+{
+	struct type_scope* s = xrealloc(NULL, sizeof(struct type_scope));
+
+	memset(s, 0, sizeof(struct type_scope));
+
+	return s;
+}
+
+void type_scope_free(struct type_scope* s)
+{
+	while (0 < s->depth)
+		type_scope_pop(s);
+
+	for (int i = 0; i < s->nbindings; i++)
+		if (NULL != s->bindings[i].t)
+			type_free(s->bindings[i].t);
+
+	for (int i = 0; i < s->nsymbols; i++)
+		free((char*)s->symbols[i].name);
+
+	free(s->slots);
+	free(s->symbols);
+	free(s->bindings);
+	free(s->marks);
+	free(s);
+}
+
+const char* type_scope_intern(struct type_scope* s, const char* name)
+{
+	return s->symbols[intern(s, name)].name;
+}
+
+int type_scope_depth(const struct type_scope* s)
+{
+	return s->depth;
+}
+
+void type_scope_push(struct type_scope* s)
+{
+	if (s->depth == s->max_depth) {
+
+		s->max_depth = (0 == s->max_depth) ? 16 : 2 * s->max_depth;
+		s->marks = xrealloc(s->marks, s->max_depth * sizeof(int));
+	}
+
+	s->marks[s->depth++] = s->nbindings;
+}
+
+void type_scope_pop(struct type_scope* s)
+{
+	assert(0 < s->depth);
+
+	int mark = s->marks[--s->depth];
+
+	while (mark < s->nbindings) {
+
+		const struct binding* b = &s->bindings[--s->nbindings];
+
+		s->symbols[b->symbol].binding[b->ns] = b->shadowed;
+
+		if (NULL != b->t)
+			type_free(b->t);
+	}
+}
+
+
+// innermost binding of a name or NULL, which are only returned
+// if they belong to the current scope if 'local' is set
+
+static const struct binding* binding(const struct type_scope* s, enum ns ns, const char* name, bool local)
+{
+	const struct symbol* y = find(s, name);
+
+	if ((NULL == y) || (-1 == y->binding[ns]))
+		return NULL;
+
+	int mark = (0 == s->depth) ? 0 : s->marks[s->depth - 1];
+
+	if (local && (y->binding[ns] < mark))
+		return NULL;
+
+	return &s->bindings[y->binding[ns]];
+}
+
+static void bind(struct type_scope* s, enum ns ns, const char* name, type t)
+{
+	int y = intern(s, name);
+
+	if (s->nbindings == s->max_bindings) {
+
+		s->max_bindings = (0 == s->max_bindings) ? 64 : 2 * s->max_bindings;
+		s->bindings = xrealloc(s->bindings, s->max_bindings * sizeof(struct binding));
+	}
+
+	s->bindings[s->nbindings] = (struct binding){ t, y, ns, s->symbols[y].binding[ns] };
+	s->symbols[y].binding[ns] = s->nbindings++;
+}
+
+
+static type tag_new(struct type_scope* s, enum type_kind kind, const char* tag)
+{
+	assert((TYPE_STRUCT == kind) || (TYPE_UNION == kind) || (TYPE_ENUM == kind));
+
+	type t = (TYPE_STRUCT == kind) ? type_struct_inc(tag)
+		: (TYPE_UNION == kind) ? type_union_inc(tag)
+		: type_enum_inc(tag);
+
+	bind(s, NS_TAG, tag, t);
+
+	return t;
+}
+
+static type tag_kind(type t, enum type_kind kind)
+{
+	return (kind == type_classify(t)) ? t : NULL;
+}
+
+// a use refers to a visible tag or declares it in the current scope
+
+type type_scope_tag(struct type_scope* s, enum type_kind kind, const char* tag)
+{
+	const struct binding* b = binding(s, NS_TAG, tag, false);
+
+	if (NULL == b)
+		return tag_new(s, kind, tag);
+
+	return tag_kind(b->t, kind);
+}
+
+// a declaration on its own hides tags of enclosing scopes
+
+type type_scope_tag_declare(struct type_scope* s, enum type_kind kind, const char* tag)
+{
+	const struct binding* b = binding(s, NS_TAG, tag, true);
+
+	if (NULL == b)
+		return tag_new(s, kind, tag);
+
+	return tag_kind(b->t, kind);
+}
+
+// returns the incomplete node to be completed by the definition
+
+type type_scope_tag_define(struct type_scope* s, enum type_kind kind, const char* tag)
+{
+	const struct binding* b = binding(s, NS_TAG, tag, true);
+
+	if (NULL == b)
+		return tag_new(s, kind, tag);
+
+	if (type_complete_p(b->t))
+		return NULL;
+
+	return tag_kind(b->t, kind);
+}
+
+type type_scope_tag_lookup(const struct type_scope* s, const char* tag)
+{
+	const struct binding* b = binding(s, NS_TAG, tag, false);
+
+	return (NULL == b) ? NULL : b->t;
+}
+
+
+// a typedef name may be redeclared in the same scope to denote
+// the same type 6.7(3)
+
+bool type_scope_typedef(struct type_scope* s, const char* name, type t)
+{
+	const struct binding* b = binding(s, NS_ORDINARY, name, true);
+
+	if (NULL != b) {
+
+		bool ok = (NULL != b->t) && type_identical_p(b->t, t);
+
+		type_free(t);
+
+		return ok;
+	}
+
+	bind(s, NS_ORDINARY, name, t);
+
+	return true;
+}
+
+bool type_scope_hide(struct type_scope* s, const char* name)
+{
+	const struct binding* b = binding(s, NS_ORDINARY, name, true);
+
+	if (NULL != b)
+		return (NULL == b->t);
+
+	bind(s, NS_ORDINARY, name, NULL);
+
+	return true;
+}
+
+type type_scope_typedef_lookup(const struct type_scope* s, const char* name)
+{
+	const struct binding* b = binding(s, NS_ORDINARY, name, false);
+
+	return (NULL == b) ? NULL : b->t;
+}
+
@@ -0,0 +1,35 @@
+
+#include <stdbool.h>
+
+struct type;
+struct type_scope;
+
+// nested scopes of tags and typedef names for a C front end
+//
+// Entered types are owned by the table (typedef names consume the
+// reference passed in), the types returned are borrowed and stay
+// valid while their scope is open. Struct, union and enum tags are
+// created incomplete and completed in place (type_complete), so all
+// uses of a tag refer to the same node. NULL is returned for a tag
+// used with the wrong kind or defined twice in the same scope.
+
+extern struct type_scope* type_scope_create(void);
+extern void type_scope_free(struct type_scope* s);
+
+extern void type_scope_push(struct type_scope* s);
+extern void type_scope_pop(struct type_scope* s);
+extern int type_scope_depth(const struct type_scope* s);
+
+extern const char* type_scope_intern(struct type_scope* s, const char* name);
+
+// struct s (a use), struct s; (a declaration), struct s { (a definition)
+extern const struct type* type_scope_tag(struct type_scope* s, enum type_kind kind, const char* tag);
+extern const struct type* type_scope_tag_declare(struct type_scope* s, enum type_kind kind, const char* tag);
+extern const struct type* type_scope_tag_define(struct type_scope* s, enum type_kind kind, const char* tag);
+extern const struct type* type_scope_tag_lookup(const struct type_scope* s, const char* tag);
+
+// typedef names and other ordinary identifiers which hide them
+extern bool type_scope_typedef(struct type_scope* s, const char* name, const struct type* t);
+extern bool type_scope_hide(struct type_scope* s, const char* name);
+extern const struct type* type_scope_typedef_lookup(const struct type_scope* s, const char* name);
+
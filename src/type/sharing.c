@@ -0,0 +1,184 @@
+/* Copyright 2021. Martin Uecker.
+ * All rights reserved. Use of this source code is governed by
+ * a BSD-style license which can be found in the LICENSE file.
+ * */
+
+#include <stdlib.h>
+#include <assert.h>
+
+#include "type.h"
+#include "abi.h"
+
+#include "sharing.h"
+
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
+#define MAX(x, y) ((x) > (y) ? (x) : (y))
+
+
+// False sharing between members of a struct. Each member is
+// marked with the class of threads writing it (zero if it is not
+// written). Two members written by different classes which touch
+// the same cache line conflict. Bit-fields touch their storage
+// unit, nested compounds are treated as a whole.
+//
+// The padding is computed in one pass over the members: before
+// a member written by a class different from the one which wrote
+// last into the current line, the member is moved to the start of
+// the next line by aligning it (bit-fields too, which then start a
+// new storage unit). Positions are taken from the layout of the
+// struct padded so far, so packed structs and bit-fields follow the
+// rules of the ABI. The padded struct is aligned to the line size,
+// so that this also holds for arrays of it.
+
+static void extent(type t, int i, size_t* start, size_t* end)
+{
+	type e = type_member_type(t, i);
+
+	if (type_bitfield_p(e)) {
+
+		struct abi_bitfield_pos pos;
+		type_bitfield_pos(t, i, &pos);
+
+		*start = pos.offset;
+		*end = pos.offset + pos.size;
+		return;
+	}
+
+	*start = type_offsetof_n(t, i);
+	*end = *start + (type_complete_p(e) ? type_sizeof(e) : 0);
+}
+
+int type_false_sharing(type t, const int writer[], size_t line, int max, struct type_sharing pairs[])
+{
+	assert(type_struct_p(t) && type_known_const_size_p(t));
+	assert((0 < line) && (0 == (line & (line - 1))));
+
+	int N = type_member_count(t);
+	int n = 0;
+
+	for (int i = 0; i < N; i++) {
+
+		size_t si, ei;
+
+		if (0 == writer[i])
+			continue;
+
+		extent(t, i, &si, &ei);
+
+		if (si == ei)
+			continue;
+
+		for (int j = i + 1; j < N; j++) {
+
+			size_t sj, ej;
+
+			if ((0 == writer[j]) || (writer[i] == writer[j]))
+				continue;
+
+			extent(t, j, &sj, &ej);
+
+			if (sj == ej)
+				continue;
+
+			// first and last lines touched by both
+
+			size_t first = MAX(si / line, sj / line);
+			size_t last = MIN((ei - 1) / line, (ej - 1) / line);
+
+			if (first > last)
+				continue;
+
+			if (n < max)
+				pairs[n] = (struct type_sharing){ i, j, first };
+
+			n++;
+		}
+	}
+
+	return n;
+}
+
+
+// the struct with the first n paddings applied
+
+static type padded(type t, int n, const struct type_padding pads[n], size_t line)
+{
+	int N = type_member_count(t);
+	struct type_element e[MAX(N, 1)];
+
+	for (int i = 0, k = 0; i < N; i++) {
+
+		e[i].name = type_member_name(t, i);
+		e[i].typ = type_ref(type_member_type(t, i));
+
+		if ((k < n) && (i == pads[k].member)) {
+
+			e[i].typ = type_aligned(e[i].typ, line);
+			k++;
+		}
+	}
+
+	return type_struct2(type_compound_tag(t), N, e, MAX((int)line, type_compound_align(t)), type_compound_packed_p(t));
+}
+
+int type_sharing_padding(type t, const int writer[], size_t line, int max, struct type_padding pads[])
+{
+	assert(type_struct_p(t) && type_known_const_size_p(t));
+	assert((0 < line) && (0 == (line & (line - 1))));
+
+	int N = type_member_count(t);
+	int n = 0;
+
+	struct type_padding all[MAX(N, 1)];
+	type p = type_ref(t);
+
+	int last = 0;		// writer of the current line
+	size_t end = 0;		// last line written
+
+	for (int i = 0; i < N; i++) {
+
+		size_t start, stop;
+
+		if (0 == writer[i])
+			continue;
+
+		extent(p, i, &start, &stop);
+
+		if (start == stop)
+			continue;
+
+		if ((0 != last) && (last != writer[i]) && (start / line <= end)) {
+
+			all[n++] = (struct type_padding){ i, 0 };
+
+			type_free(p);
+			p = padded(t, n, all, line);
+
+			size_t moved = start;
+
+			extent(p, i, &start, &stop);
+
+			all[n - 1].bytes = start - moved;
+		}
+
+		last = writer[i];
+		end = (stop - 1) / line;
+	}
+
+	type_free(p);
+
+	for (int k = 0; k < MIN(n, max); k++)
+		pads[k] = all[k];
+
+	return n;
+}
+
+type type_sharing_padded(type t, const int writer[], size_t line)
+{
+	int n = type_sharing_padding(t, writer, line, 0, NULL);
+	struct type_padding pads[MAX(n, 1)];
+
+	type_sharing_padding(t, writer, line, n, pads);
+
+	return padded(t, n, pads, line);
+}
@@ -0,0 +1,22 @@
+
+#include <stddef.h>
+
+struct type;
+
+struct type_sharing {
+
+	int a;		// members
+	int b;
+	size_t line;	// first cache line both touch
+};
+
+struct type_padding {
+
+	int member;	// padding is inserted before
+	size_t bytes;
+};
+
+extern int type_false_sharing(const struct type* t, const int writer[], size_t line, int max, struct type_sharing pairs[]);
+extern int type_sharing_padding(const struct type* t, const int writer[], size_t line, int max, struct type_padding pads[]);
+extern const struct type* type_sharing_padded(const struct type* t, const int writer[], size_t line);
+
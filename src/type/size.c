@@ -0,0 +1,562 @@
+/* Copyright 2021. Martin Uecker.
+ * All rights reserved. Use of this source code is governed by
+ * a BSD-style license which can be found in the LICENSE file.
+ * */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "type.h"
+#include "abi.h"
+#include "visit.h"
+
+#include "size.h"
+
+
+// A size plan is a small program for a stack machine which computes
+// the size (and member offsets) of a variably modified type from the
+// values of the VLA bounds it depends on. Bounds are indexed in the
+// order of type_dependency_list. Constant parts are folded when the
+// plan is built.
+//
+// A run of bit-fields which follows a member of variable size is
+// placed by the ABI relative to its start modulo the largest
+// alignment in the run. For each residue the layout of the run is
+// taken from a probe struct when the plan is built.
+
+enum op_code { OP_CONST, OP_BOUND, OP_ADD, OP_MUL, OP_MAX, OP_ALIGN, OP_OFFSET, OP_BITFIELDS };
+
+struct op {
+
+	enum op_code code;
+	size_t arg;
+};
+
+struct run {
+
+	int first;
+	int n;
+	bool top;		// member offsets are recorded
+	size_t align;
+	size_t* pos;		// per residue n offsets and the end
+};
+
+struct type_size_plan {
+
+	int N;
+	int depth;
+	int nmembers;
+	size_t* offsets;	// constant offsets
+	int nruns;
+	struct run* runs;
+	struct op ops[];
+};
+
+
+static void* xrealloc(void* p, size_t s)
+{
+	p = realloc(p, s);
+
+	if (NULL == p)
+		abort();
+
+	return p;
+}
+
+
+
+struct vla {
+
+	type t;
+	int index;
+};
+
+struct builder {
+
+	int N;
+	int size;
+	int sp;
+	int depth;
+	struct op* ops;
+
+	int nvla;
+	struct vla* vla;
+
+	size_t* offsets;
+
+	int nruns;
+	struct run* runs;
+};
+
+
+static void emit(struct builder* b, enum op_code code, size_t arg)
+{
+	if (b->N == b->size) {
+
+		b->size = (0 == b->size) ? 16 : 2 * b->size;
+		b->ops = xrealloc(b->ops, b->size * sizeof(struct op));
+	}
+
+	b->ops[b->N++] = (struct op){ code, arg };
+
+	switch (code) {
+
+	case OP_CONST:
+	case OP_BOUND:
+		b->sp++;
+		break;
+
+	case OP_ADD:
+	case OP_MUL:
+	case OP_MAX:
+		b->sp--;
+		break;
+
+	default:
+		break;
+	}
+
+	if (b->sp > b->depth)
+		b->depth = b->sp;
+}
+
+static bool last_const_p(const struct builder* b, int n)
+{
+	if (b->N < n)
+		return false;
+
+	for (int i = 1; i <= n; i++)
+		if (OP_CONST != b->ops[b->N - i].code)
+			return false;
+
+	return true;
+}
+
+static void emit_const(struct builder* b, size_t c)
+{
+	emit(b, OP_CONST, c);
+}
+
+static void emit_binary(struct builder* b, enum op_code code)
+{
+	if (last_const_p(b, 2)) {
+
+		size_t x = b->ops[b->N - 2].arg;
+		size_t y = b->ops[b->N - 1].arg;
+
+		b->N -= 2;
+		b->sp -= 2;
+
+		switch (code) {
+
+		case OP_ADD: emit_const(b, x + y); return;
+		case OP_MUL: emit_const(b, x * y); return;
+		case OP_MAX: emit_const(b, (x > y) ? x : y); return;
+		default: assert(0);
+		}
+	}
+
+	emit(b, code, 0);
+}
+
+static void emit_align(struct builder* b, size_t a)
+{
+	assert(0 == (a & (a - 1)));
+
+	if (1 == a)
+		return;
+
+	if (last_const_p(b, 1)) {
+
+		struct op* op = &b->ops[b->N - 1];
+		op->arg = (op->arg + a - 1) & ~(a - 1);
+		return;
+	}
+
+	emit(b, OP_ALIGN, a);
+}
+
+
+static int vla_cmp(const void* _a, const void* _b)
+{
+	const struct vla* a = _a;
+	const struct vla* b = _b;
+
+	if (a->t != b->t)
+		return (a->t < b->t) ? -1 : 1;
+
+	return a->index - b->index;
+}
+
+static enum type_visit vla_collect(void* ctx, type t)
+{
+	struct builder* b = ctx;
+
+	// this has to match the traversal for type_dependency_list
+
+	if (!type_variably_modified_p(t))
+		return TYPE_VISIT_SKIP;
+
+	if (type_array_vla_p(t)) {
+
+		if (0 == (b->nvla & (b->nvla - 1)))
+			b->vla = xrealloc(b->vla, (b->nvla ? 2 * b->nvla : 1) * sizeof(struct vla));
+
+		b->vla[b->nvla] = (struct vla){ type_base(t), b->nvla };
+		b->nvla++;
+	}
+
+	return TYPE_VISIT_CONTINUE;
+}
+
+static int vla_index(const struct builder* b, type t)
+{
+	struct vla key = { type_base(t), 0 };
+	int lo = 0;
+	int hi = b->nvla;
+
+	// first entry for this node
+
+	while (lo < hi) {
+
+		int mid = (lo + hi) / 2;
+
+		if (vla_cmp(&b->vla[mid], &key) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	assert((lo < b->nvla) && (b->vla[lo].t == key.t));
+
+	return b->vla[lo].index;
+}
+
+
+static void emit_size(struct builder* b, type t, bool top);
+
+static void emit_array(struct builder* b, type t)
+{
+	int n = 0;
+	type* dims = NULL;
+
+	for (; type_array_p(t) && type_variably_modified_p(t); t = type_array_element(t)) {
+
+		if (0 == (n & (n - 1)))
+			dims = xrealloc(dims, (n ? 2 * n : 1) * sizeof(type));
+
+		dims[n++] = t;
+	}
+
+	emit_size(b, t, false);
+
+	while (0 < n--) {
+
+		if (type_array_vla_p(dims[n]))
+			emit(b, OP_BOUND, vla_index(b, dims[n]));
+		else
+			emit_const(b, type_array_length(dims[n]));
+
+		emit_binary(b, OP_MUL);
+	}
+
+	free(dims);
+}
+
+// offsets of the members of a run and its end, relative to an offset
+// which is a multiple of the alignment of the run
+
+static const size_t* run_place(const struct run* r, size_t x, size_t* base)
+{
+	*base = x / r->align * r->align;
+
+	return r->pos + (x - *base) * (r->n + 1);
+}
+
+static void emit_bitfields(struct builder* b, type t, int first, int n, bool top)
+{
+	size_t align = 1;
+
+	for (int i = 0; i < n; i++)
+		if (align < type_alignof(type_member_type(t, first + i)))
+			align = type_alignof(type_member_type(t, first + i));
+
+	struct run r = { first, n, top, align, xrealloc(NULL, align * (n + 1) * sizeof(size_t)) };
+
+	// a probe { char pad[res]; <run>; char end; } per residue, the
+	// offset of the last member is where the run ends
+
+	for (size_t res = 0; res < align; res++) {
+
+		struct type_element e[n + 2];
+		int k = 0;
+
+		if (0 < res)
+			e[k++] = (struct type_element){ "", type_array(res, type_basic(TYPE_CHAR)) };
+
+		for (int i = 0; i < n; i++)
+			e[k++] = (struct type_element){ type_member_name(t, first + i), type_ref(type_member_type(t, first + i)) };
+
+		e[k++] = (struct type_element){ "", type_basic(TYPE_CHAR) };
+
+		type probe = type_struct2("", k, e, 0, type_compound_packed_p(t));
+
+		for (int i = 0; i <= n; i++)
+			r.pos[res * (n + 1) + i] = type_offsetof_n(probe, k - n - 1 + i);
+
+		type_free(probe);
+	}
+
+	if (last_const_p(b, 1)) {
+
+		size_t base;
+		const size_t* pos = run_place(&r, b->ops[b->N - 1].arg, &base);
+
+		if (top)
+			for (int i = 0; i < n; i++)
+				b->offsets[first + i] = base + pos[i];
+
+		b->ops[b->N - 1].arg = base + pos[n];
+
+		free(r.pos);
+		return;
+	}
+
+	if (0 == (b->nruns & (b->nruns - 1)))
+		b->runs = xrealloc(b->runs, (b->nruns ? 2 * b->nruns : 1) * sizeof(struct run));
+
+	b->runs[b->nruns] = r;
+
+	emit(b, OP_BITFIELDS, b->nruns++);
+}
+
+static void emit_member(struct builder* b, type m)
+{
+	if (type_array_p(m) && !type_complete_p(m))	// flexible array member
+		emit_const(b, 0);
+	else
+		emit_size(b, m, false);
+}
+
+static void emit_struct(struct builder* b, type t, bool top)
+{
+	int N = type_member_count(t);
+	int k = 0;
+
+	// the offsets up to the first variably modified member are constant
+
+	while ((k < N) && !type_variably_modified_p(type_member_type(t, k))) {
+
+		if (top)
+			b->offsets[k] = type_offsetof_n(t, k);
+
+		k++;
+	}
+
+	assert(k < N);
+
+	emit_const(b, type_offsetof_n(t, k));
+
+	for (int i = k; i < N; i++) {
+
+		type m = type_member_type(t, i);
+
+		if (type_bitfield_p(m)) {
+
+			int n = 1;
+
+			while ((i + n < N) && type_bitfield_p(type_member_type(t, i + n)))
+				n++;
+
+			emit_bitfields(b, t, i, n, top);
+
+			i += n - 1;
+			continue;
+		}
+
+		assert(!type_compound_packed_p(t));
+
+		emit_align(b, type_alignof(m));
+
+		if (top)
+			emit(b, OP_OFFSET, i);
+
+		emit_member(b, m);
+		emit_binary(b, OP_ADD);
+	}
+
+	emit_align(b, type_alignof(t));
+}
+
+static void emit_union(struct builder* b, type t)
+{
+	int N = type_member_count(t);
+
+	emit_const(b, 0);
+
+	for (int i = 0; i < N; i++) {
+
+		emit_member(b, type_member_type(t, i));
+		emit_binary(b, OP_MAX);
+	}
+
+	emit_align(b, type_alignof(t));
+}
+
+static void emit_size(struct builder* b, type t, bool top)
+{
+	if (!type_variably_modified_p(t)) {
+
+		emit_const(b, type_sizeof(t));
+		return;
+	}
+
+	switch (type_classify(t)) {
+
+	case TYPE_ARRAY:
+		emit_array(b, t);
+		break;
+
+	case TYPE_STRUCT:
+		emit_struct(b, t, top);
+		break;
+
+	case TYPE_UNION:
+		emit_union(b, t);
+		break;
+
+	default:	// pointers
+		emit_const(b, type_sizeof(t));
+		break;
+	}
+}
+
+
+struct type_size_plan* type_size_plan(const struct type* t)
+{
+	struct builder b = { 0 };
+
+	int nmembers = type_compound_p(t) ? type_member_count(t) : 0;
+
+	if (0 < nmembers) {
+
+		b.offsets = xrealloc(NULL, nmembers * sizeof(size_t));
+
+		for (int i = 0; i < nmembers; i++)
+			b.offsets[i] = 0;
+	}
+
+	type_visit(t, TYPE_VISIT_MEMBERS, vla_collect, NULL, &b);
+
+	if (0 < b.nvla)
+		qsort(b.vla, b.nvla, sizeof(struct vla), vla_cmp);
+
+	if (type_struct_p(t) && !type_variably_modified_p(t)) {
+
+		for (int i = 0; i < nmembers; i++)
+			b.offsets[i] = type_offsetof_n(t, i);
+	}
+
+	emit_size(&b, t, true);
+
+	assert(1 == b.sp);
+
+	struct type_size_plan* p = xrealloc(NULL, sizeof(struct type_size_plan) + b.N * sizeof(struct op));
+
+	p->N = b.N;
+	p->depth = b.depth;
+	p->nmembers = nmembers;
+	p->offsets = b.offsets;
+	p->nruns = b.nruns;
+	p->runs = b.runs;
+
+	memcpy(p->ops, b.ops, b.N * sizeof(struct op));
+
+	free(b.ops);
+	free(b.vla);
+
+	return p;
+}
+
+void type_size_plan_free(struct type_size_plan* p)
+{
+	for (int i = 0; i < p->nruns; i++)
+		free(p->runs[i].pos);
+
+	free(p->runs);
+	free(p->offsets);
+	free(p);
+}
+
+
+// offsets (of the members of a struct) can be NULL
+
+size_t type_size_plan_eval(const struct type_size_plan* p, const size_t bounds[], size_t offsets[])
+{
+	size_t stack[p->depth];
+	int sp = 0;
+
+	if ((NULL != offsets) && (0 < p->nmembers))
+		memcpy(offsets, p->offsets, p->nmembers * sizeof(size_t));
+
+	for (int i = 0; i < p->N; i++) {
+
+		const struct op* op = &p->ops[i];
+
+		switch (op->code) {
+
+		case OP_CONST:
+			stack[sp++] = op->arg;
+			break;
+
+		case OP_BOUND:
+			stack[sp++] = bounds[op->arg];
+			break;
+
+		case OP_ADD:
+			sp--;
+			stack[sp - 1] += stack[sp];
+			break;
+
+		case OP_MUL:
+			sp--;
+			stack[sp - 1] *= stack[sp];
+			break;
+
+		case OP_MAX:
+			sp--;
+			if (stack[sp] > stack[sp - 1])
+				stack[sp - 1] = stack[sp];
+			break;
+
+		case OP_ALIGN:
+			stack[sp - 1] = (stack[sp - 1] + op->arg - 1) & ~(op->arg - 1);
+			break;
+
+		case OP_OFFSET:
+			if (NULL != offsets)
+				offsets[op->arg] = stack[sp - 1];
+			break;
+
+		case OP_BITFIELDS: {
+
+			const struct run* r = &p->runs[op->arg];
+			size_t base;
+			const size_t* pos = run_place(r, stack[sp - 1], &base);
+
+			if (r->top && (NULL != offsets))
+				for (int j = 0; j < r->n; j++)
+					offsets[r->first + j] = base + pos[j];
+
+			stack[sp - 1] = base + pos[r->n];
+			break;
+		}
+		}
+	}
+
+	assert(1 == sp);
+
+	return stack[0];
+}
+
@@ -0,0 +1,10 @@
+
+#include <stddef.h>
+
+struct type;
+struct type_size_plan;
+
+extern struct type_size_plan* type_size_plan(const struct type* t);
+extern void type_size_plan_free(struct type_size_plan* p);
+extern size_t type_size_plan_eval(const struct type_size_plan* p, const size_t bounds[], size_t offsets[]);
+
@@ -0,0 +1,300 @@
+/* Copyright 2021. Martin Uecker.
+ * All rights reserved. Use of this source code is governed by
+ * a BSD-style license which can be found in the LICENSE file.
+ * */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+
+#include "type.h"
+#include "abi.h"
+
+#include "soa.h"
+
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
+#define MAX(x, y) ((x) > (y) ? (x) : (y))
+#define HOST_BIG (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+
+
+// The struct-of-arrays form of a struct has one array for each
+// member, aligned to SIMD_ALIGN. Bit-fields become arrays of their
+// declared type.
+//
+// Transposition runs over blocks of records which fit into the
+// first level cache, one member at a time, so that the inner
+// loops have fixed strides.
+
+enum { SIMD_ALIGN = 64, BLOCK_BYTES = 16384 };
+
+struct member {
+
+	size_t aos;		// offset (storage unit for bit-fields)
+	size_t soa;		// offset of the array
+	int size;		// of an element
+	bool bits;
+
+	// bit-fields
+
+	bool sign;
+	int unit;
+	int shift;
+	int width;
+};
+
+struct type_soa_plan {
+
+	int N;
+	size_t stride;
+	int block;
+
+	int M;
+	struct member m[];
+};
+
+
+static void* xmalloc(size_t s)
+{
+	void* p = malloc(s);
+
+	if (NULL == p)
+		abort();
+
+	return p;
+}
+
+type type_soa(type t, int N)
+{
+	assert(type_struct_p(t) && type_known_const_size_p(t));
+
+	int M = type_member_count(t);
+	struct type_element e[MAX(M, 1)];
+
+	for (int i = 0; i < M; i++) {
+
+		type m = type_member_type(t, i);
+
+		m = type_bitfield_p(m) ? type_bitfield_type(m) : type_ref(m);
+
+		e[i].name = type_member_name(t, i);
+		e[i].typ = type_aligned(type_array(N, m), SIMD_ALIGN);
+	}
+
+	// a tag of its own, so that both can be defined in one unit
+
+	const char* tag = type_compound_tag(t);
+
+	if ('\0' == tag[0])
+		return type_struct("", M, e);
+
+	char* stag = xmalloc(strlen(tag) + sizeof("_soa"));
+	strcpy(stag, tag);
+	strcat(stag, "_soa");
+
+	type s = type_struct(stag, M, e);
+
+	free(stag);
+
+	return s;
+}
+
+
+struct type_soa_plan* type_soa_plan(type t, int N)
+{
+	type s = type_soa(t, N);
+	int M = type_member_count(t);
+
+	struct type_soa_plan* p = xmalloc(sizeof(struct type_soa_plan) + M * sizeof(struct member));
+
+	p->N = N;
+	p->stride = type_sizeof(t);
+	p->block = MAX(1, BLOCK_BYTES / (int)MAX(p->stride, 1));
+	p->M = M;
+
+	for (int i = 0; i < M; i++) {
+
+		type m = type_member_type(t, i);
+		struct member* q = &p->m[i];
+
+		q->soa = type_offsetof_n(s, i);
+		q->size = type_sizeof(type_array_element(type_member_type(s, i)));
+		q->bits = type_bitfield_p(m);
+
+		assert(0 == q->soa % SIMD_ALIGN);
+
+		if (!q->bits) {
+
+			q->aos = type_offsetof_n(t, i);
+			continue;
+		}
+
+		struct abi_bitfield_pos pos;
+		type_bitfield_pos(t, i, &pos);
+
+		q->aos = pos.offset;
+		q->sign = type_signed_p(m) || (type_character_p(m) && (CHAR_MIN < 0))
+			|| (type_enum_p(m) && type_signed_p(type_enum_underlying(m)));
+		q->unit = pos.size;
+		q->shift = pos.shift;
+		q->width = pos.width;
+	}
+
+	type_free(s);
+
+	return p;
+}
+
+void type_soa_plan_free(struct type_soa_plan* p)
+{
+	free(p);
+}
+
+
+
+static uint64_t load(const char* p, int size)
+{
+	switch (size) {
+
+	case 1: { uint8_t v; memcpy(&v, p, 1); return v; }
+	case 2: { uint16_t v; memcpy(&v, p, 2); return v; }
+	case 4: { uint32_t v; memcpy(&v, p, 4); return v; }
+	case 8: { uint64_t v; memcpy(&v, p, 8); return v; }
+
+	default: {
+
+		// storage units of packed bit-fields
+
+		assert((0 < size) && (size < 8));
+
+		uint64_t v = 0;
+		memcpy((char*)&v + (HOST_BIG ? 8 - size : 0), p, size);
+		return v;
+	}
+	}
+}
+
+static void store(char* p, int size, uint64_t v)
+{
+	switch (size) {
+
+	case 1: { uint8_t x = v; memcpy(p, &x, 1); return; }
+	case 2: { uint16_t x = v; memcpy(p, &x, 2); return; }
+	case 4: { uint32_t x = v; memcpy(p, &x, 4); return; }
+	case 8: { uint64_t x = v; memcpy(p, &x, 8); return; }
+
+	default:
+
+		assert((0 < size) && (size < 8));
+		memcpy(p, (char*)&v + (HOST_BIG ? 8 - size : 0), size);
+		return;
+	}
+}
+
+static uint64_t mask(int width)
+{
+	return (64 == width) ? ~UINT64_C(0) : ((UINT64_C(1) << width) - 1);
+}
+
+
+// the element size is a constant in each loop so that
+// the compiler can specialize the copy
+
+#define GATHER(S)							\
+	for (int r = 0; r < n; r++)					\
+		memcpy(d + r * (S), s + r * stride, (S));
+
+#define SCATTER(S)							\
+	for (int r = 0; r < n; r++)					\
+		memcpy(d + r * stride, s + r * (S), (S));
+
+static void gather(const struct member* q, int n, char* d, const char* s, size_t stride)
+{
+	if (q->bits) {
+
+		for (int r = 0; r < n; r++) {
+
+			uint64_t v = (load(s + r * stride, q->unit) >> q->shift) & mask(q->width);
+
+			if (q->sign && (q->width < 64) && (v >> (q->width - 1)))
+				v |= ~mask(q->width);
+
+			store(d + r * q->size, q->size, v);
+		}
+
+		return;
+	}
+
+	switch (q->size) {
+
+	case 1: GATHER(1); break;
+	case 2: GATHER(2); break;
+	case 4: GATHER(4); break;
+	case 8: GATHER(8); break;
+	case 16: GATHER(16); break;
+	default: GATHER(q->size); break;
+	}
+}
+
+static void scatter(const struct member* q, int n, char* d, const char* s, size_t stride)
+{
+	if (q->bits) {
+
+		uint64_t m = mask(q->width) << q->shift;
+
+		for (int r = 0; r < n; r++) {
+
+			uint64_t u = load(d + r * stride, q->unit);
+			uint64_t v = load(s + r * q->size, q->size);
+
+			store(d + r * stride, q->unit, (u & ~m) | ((v << q->shift) & m));
+		}
+
+		return;
+	}
+
+	switch (q->size) {
+
+	case 1: SCATTER(1); break;
+	case 2: SCATTER(2); break;
+	case 4: SCATTER(4); break;
+	case 8: SCATTER(8); break;
+	case 16: SCATTER(16); break;
+	default: SCATTER(q->size); break;
+	}
+}
+
+
+void type_soa_from_aos(const struct type_soa_plan* p, void* soa, const void* aos)
+{
+	for (int b = 0; b < p->N; b += p->block) {
+
+		int n = MIN(p->block, p->N - b);
+		const char* s = (const char*)aos + b * p->stride;
+
+		for (int i = 0; i < p->M; i++) {
+
+			const struct member* q = &p->m[i];
+
+			gather(q, n, (char*)soa + q->soa + b * q->size, s + q->aos, p->stride);
+		}
+	}
+}
+
+void type_soa_to_aos(const struct type_soa_plan* p, void* aos, const void* soa)
+{
+	for (int b = 0; b < p->N; b += p->block) {
+
+		int n = MIN(p->block, p->N - b);
+		char* d = (char*)aos + b * p->stride;
+
+		for (int i = 0; i < p->M; i++) {
+
+			const struct member* q = &p->m[i];
+
+			scatter(q, n, d + q->aos, (const char*)soa + q->soa + b * q->size, p->stride);
+		}
+	}
+}
+
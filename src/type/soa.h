@@ -0,0 +1,10 @@
+
+struct type;
+struct type_soa_plan;
+
+extern const struct type* type_soa(const struct type* t, int N);
+extern struct type_soa_plan* type_soa_plan(const struct type* t, int N);
+extern void type_soa_plan_free(struct type_soa_plan* p);
+extern void type_soa_from_aos(const struct type_soa_plan* p, void* soa, const void* aos);
+extern void type_soa_to_aos(const struct type_soa_plan* p, void* aos, const void* soa);
+
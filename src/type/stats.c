@@ -0,0 +1,270 @@
+/* Copyright 2021. Martin Uecker.
+ * All rights reserved. Use of this source code is governed by
+ * a BSD-style license which can be found in the LICENSE file.
+ * */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#ifdef TYPE_STATS
+#include <pthread.h>
+#endif
+
+#include "type.h"
+#include "cache.h"
+
+#include "stats.h"
+
+
+// Each thread counts into its own block, which is registered in
+// a global list on first use and folded into the retired totals
+// when the thread exits. Reading sums all blocks. Counters are
+// only written by their owner, with relaxed atomic stores, so
+// updates need no locking.
+//
+// Peak values are high-water marks per thread which are summed.
+// They are exact in single-threaded programs and an upper bound
+// otherwise.
+
+static const char* kind_names[TYPE_NR_KINDS] = {
+
+	[TYPE_VOID] = "void",
+	[TYPE_UNION] = "union",
+	[TYPE_STRUCT] = "struct",
+	[TYPE_ARRAY] = "array",
+	[TYPE_POINTER] = "pointer",
+	[TYPE_FUNCTION] = "function",
+	[TYPE_BOOL] = "bool",
+	[TYPE_CHAR] = "char",
+	[TYPE_ENUM] = "enum",
+	[TYPE_ARGLIST] = "arglist",
+	[TYPE_SCHAR] = "signed char",
+	[TYPE_SHORT] = "short",
+	[TYPE_INT] = "int",
+	[TYPE_LONG] = "long",
+	[TYPE_LONGLONG] = "long long",
+	[TYPE_FLOAT] = "float",
+	[TYPE_DOUBLE] = "double",
+	[TYPE_LONGDOUBLE] = "long double",
+	[TYPE_VECTOR] = "vector",
+	[TYPE_BITINT] = "_BitInt",
+	[TYPE_MODIFIED] = "modified",
+};
+
+static const char* mem_names[TYPE_MEM_NR] = {
+
+	[TYPE_MEM_NODES] = "nodes",
+	[TYPE_MEM_MEMBERS] = "members",
+	[TYPE_MEM_NAMES] = "names",
+	[TYPE_MEM_CACHE] = "cache",
+};
+
+
+#ifdef TYPE_STATS
+
+struct counters {
+
+	long long allocs[TYPE_NR_KINDS];
+	long long frees[TYPE_NR_KINDS];
+	long long peak[TYPE_NR_KINDS];
+	long long bytes[TYPE_NR_KINDS];
+	long long peak_bytes[TYPE_NR_KINDS];
+
+	long long mem[TYPE_MEM_NR];
+	long long mem_peak[TYPE_MEM_NR];
+};
+
+struct block {
+
+	struct counters c;
+	struct block* next;
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static pthread_key_t key;
+
+static struct block* blocks = NULL;
+static struct counters retired;
+
+static _Thread_local struct block* local = NULL;
+
+
+#define LOAD(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define STORE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+
+static void add(struct counters* d, const struct counters* s)
+{
+	for (int k = 0; k < TYPE_NR_KINDS; k++) {
+
+		d->allocs[k] += LOAD(s->allocs[k]);
+		d->frees[k] += LOAD(s->frees[k]);
+		d->peak[k] += LOAD(s->peak[k]);
+		d->bytes[k] += LOAD(s->bytes[k]);
+		d->peak_bytes[k] += LOAD(s->peak_bytes[k]);
+	}
+
+	for (int m = 0; m < TYPE_MEM_NR; m++) {
+
+		d->mem[m] += LOAD(s->mem[m]);
+		d->mem_peak[m] += LOAD(s->mem_peak[m]);
+	}
+}
+
+static void retire(void* p)
+{
+	struct block* b = p;
+
+	pthread_mutex_lock(&lock);
+
+	add(&retired, &b->c);
+
+	struct block** q = &blocks;
+
+	while (*q != b)
+		q = &(*q)->next;
+
+	*q = b->next;
+
+	pthread_mutex_unlock(&lock);
+
+	free(b);
+}
+
+static void key_init(void)
+{
+	pthread_key_create(&key, retire);
+}
+
+static struct counters* counters(void)
+{
+	if (NULL == local) {
+
+		struct block* b = calloc(1, sizeof(struct block));
+
+		if (NULL == b)
+			abort();
+
+		pthread_once(&once, key_init);
+		pthread_setspecific(key, b);
+
+		pthread_mutex_lock(&lock);
+
+		b->next = blocks;
+		blocks = b;
+
+		pthread_mutex_unlock(&lock);
+
+		local = b;
+	}
+
+	return &local->c;
+}
+
+void type_stats_node(int k, int n)
+{
+	struct counters* c = counters();
+
+	if (0 < n) {
+
+		STORE(c->allocs[k], c->allocs[k] + n);
+
+		long long live = c->allocs[k] - c->frees[k];
+
+		if (live > c->peak[k])
+			STORE(c->peak[k], live);
+
+	} else {
+
+		STORE(c->frees[k], c->frees[k] - n);
+	}
+}
+
+void type_stats_bytes(int k, int m, long long bytes)
+{
+	struct counters* c = counters();
+
+	STORE(c->bytes[k], c->bytes[k] + bytes);
+	STORE(c->mem[m], c->mem[m] + bytes);
+
+	if (c->bytes[k] > c->peak_bytes[k])
+		STORE(c->peak_bytes[k], c->bytes[k]);
+
+	if (c->mem[m] > c->mem_peak[m])
+		STORE(c->mem_peak[m], c->mem[m]);
+}
+
+bool type_stats(struct type_stats* s)
+{
+	struct counters sum;
+
+	pthread_mutex_lock(&lock);
+
+	sum = retired;
+
+	for (struct block* b = blocks; NULL != b; b = b->next)
+		add(&sum, &b->c);
+
+	pthread_mutex_unlock(&lock);
+
+	for (int k = 0; k < TYPE_NR_KINDS; k++) {
+
+		s->kind[k] = (struct type_stats_kind){
+
+			.allocs = sum.allocs[k],
+			.frees = sum.frees[k],
+			.live = sum.allocs[k] - sum.frees[k],
+			.peak = sum.peak[k],
+			.bytes = sum.bytes[k],
+			.peak_bytes = sum.peak_bytes[k],
+		};
+	}
+
+	for (int m = 0; m < TYPE_MEM_NR; m++)
+		s->mem[m] = (struct type_stats_mem){ sum.mem[m], sum.mem_peak[m] };
+
+	return true;
+}
+
+#else
+
+bool type_stats(struct type_stats* s)
+{
+	memset(s, 0, sizeof(struct type_stats));
+	return false;
+}
+
+#endif
+
+
+void type_stats_dump(FILE* fp)
+{
+	struct type_stats s;
+
+	if (!type_stats(&s)) {
+
+		fprintf(fp, "type statistics not enabled (TYPE_STATS)\n");
+		return;
+	}
+
+	fprintf(fp, "%-12s %12s %12s %12s %12s %14s %14s\n",
+		"kind", "allocs", "frees", "live", "peak", "bytes", "peak bytes");
+
+	for (int k = 0; k < TYPE_NR_KINDS; k++) {
+
+		const struct type_stats_kind* x = &s.kind[k];
+
+		if (0 == x->allocs + x->frees)
+			continue;
+
+		fprintf(fp, "%-12s %12lld %12lld %12lld %12lld %14lld %14lld\n",
+			kind_names[k], x->allocs, x->frees, x->live, x->peak, x->bytes, x->peak_bytes);
+	}
+
+	fprintf(fp, "\n%-12s %14s %14s\n", "memory", "bytes", "peak bytes");
+
+	for (int m = 0; m < TYPE_MEM_NR; m++)
+		fprintf(fp, "%-12s %14lld %14lld\n", mem_names[m], s.mem[m].bytes, s.mem[m].peak);
+}
+
@@ -0,0 +1,33 @@
+
+#include <stdbool.h>
+#include <stdio.h>
+
+// allocation statistics (if built with TYPE_STATS)
+
+enum type_mem { TYPE_MEM_NODES, TYPE_MEM_MEMBERS, TYPE_MEM_NAMES, TYPE_MEM_CACHE, TYPE_MEM_NR };
+
+struct type_stats_kind {
+
+	long long allocs;
+	long long frees;
+	long long live;
+	long long peak;
+	long long bytes;	// live, including members and names
+	long long peak_bytes;
+};
+
+struct type_stats_mem {
+
+	long long bytes;
+	long long peak;
+};
+
+struct type_stats {
+
+	struct type_stats_kind kind[TYPE_NR_KINDS];
+	struct type_stats_mem mem[TYPE_MEM_NR];
+};
+
+extern bool type_stats(struct type_stats* s);
+extern void type_stats_dump(FILE* fp);
+
@@ -0,0 +1,46 @@
+/* Copyright 2021. Martin Uecker.
+ * All rights reserved. Use of this source code is governed by
+ * a BSD-style license which can be found in the LICENSE file.
+ * */
+
+#include <stdbool.h>
+#include <time.h>
+
+#include "type.h"
+#include "cache.h"
+
+#include "trace.h"
+
+
+bool type_trace_on = false;
+
+static type_trace_f* trace_hook = NULL;
+static void* trace_ctx = NULL;
+
+
+void type_trace(type_trace_f* hook, void* ctx)
+{
+	__atomic_store_n(&type_trace_on, false, __ATOMIC_RELAXED);
+
+	trace_hook = hook;
+	trace_ctx = ctx;
+
+	__atomic_store_n(&type_trace_on, (NULL != hook), __ATOMIC_RELEASE);
+}
+
+unsigned long long type_trace_clock(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void type_trace_event(int event, int kind, unsigned long long start)
+{
+	type_trace_f* hook = trace_hook;
+
+	if (NULL != hook)
+		hook(trace_ctx, event, kind, type_trace_clock() - start);
+}
+
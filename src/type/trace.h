@@ -0,0 +1,15 @@
+
+// tracing of node allocation, layout computation, compatibility
+// checks, and printing
+//
+// The hook is called after each event with the kind of the node
+// and the duration in nanoseconds. Events may nest. Tracing is
+// disabled with a NULL hook and then costs one branch per event.
+// The hook should be set while no other thread uses the library.
+
+enum type_trace_event { TYPE_TRACE_ALLOC, TYPE_TRACE_LAYOUT, TYPE_TRACE_COMPATIBLE, TYPE_TRACE_PRINT, TYPE_TRACE_NR };
+
+typedef void type_trace_f(void* ctx, enum type_trace_event event, enum type_kind kind, unsigned long long ns);
+
+extern void type_trace(type_trace_f* hook, void* ctx);
+
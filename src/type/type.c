@@ -8,8 +8,46 @@
 #include <assert.h>
 #include <string.h>
 #include <stdbool.h>
+#include <limits.h>
+#include <pthread.h>
 
 #include "type.h"
+#include "abi.h"
+#include "visit.h"
+#include "cache.h"
+#include "trace.h"
+#include "value.h"
+
+#ifdef TYPE_STATS
+#include <stdio.h>
+#include "stats.h"
+#define STATS_NODE(k, n)	type_stats_node(k, n)
+#define STATS_BYTES(k, m, b)	type_stats_bytes(k, m, b)
+#else
+#define STATS_NODE(k, n)	((void)(k))
+#define STATS_BYTES(k, m, b)	((void)(k))
+#endif
+
+#ifdef TYPE_DEBUG
+#define DEBUG_ALLOC(t, k)	type_debug_alloc(t, k)
+#define DEBUG_REF(t, d)		type_debug_ref(t, d)
+#define NODE_GET()		xmalloc(sizeof(struct type))
+#define NODE_FREE(t)		type_debug_free(t)	// quarantined
+#else
+#define DEBUG_ALLOC(t, k)
+#define DEBUG_REF(t, d)
+#define NODE_GET()		node_get()
+#define NODE_FREE(t)		node_put(t)
+#endif
+
+#ifdef TYPE_GC
+#include "gc.h"
+#define GC_LINK(t)		gc_link(t)
+#define GC_UNLINK(t)		gc_unlink(t)
+#else
+#define GC_LINK(t)
+#define GC_UNLINK(t)
+#endif
 
 
 #define UNSIGNED	1
@@ -20,6 +58,26 @@
 #define ATOMIC		32
 #define BITFIELD	64
 #define WIDE		128
+#define ALIGNED		256
+
+#define QUALIFIERS	(CONST|VOLATILE|RESTRICT|WIDE)
+
+// properties precomputed at construction
+
+#define P_SIGNED	1
+#define P_UNSIGNED	2
+#define P_CHARACTER	4
+#define P_FLOAT		8
+#define P_INTEGER	16
+#define P_BASIC		32
+#define P_ARITHMETIC	64
+#define P_SCALAR	128
+#define P_COMPLETE	256
+#define P_CONST_SIZE	512
+#define P_VM		1024
+#define P_PENDING	2048	// depends on an incomplete compound
+
+#define MAX_BITINT	65535
 
 static void* xmalloc(size_t s)
 {
@@ -36,6 +94,28 @@ static void xfree(const void* x)
 	free((void*)x);
 }
 
+// names are owned by the node
+
+static const char* name_dup(enum type_kind k, const char* s)
+{
+	if (NULL == s)
+		return NULL;
+
+	STATS_BYTES(k, TYPE_MEM_NAMES, strlen(s) + 1);
+
+	return strdup(s);
+}
+
+static void name_free(enum type_kind k, const char* s)
+{
+	if (NULL == s)
+		return;
+
+	STATS_BYTES(k, TYPE_MEM_NAMES, -(long long)(strlen(s) + 1));
+
+	xfree(s);
+}
+
 struct type_member {
 
 	const char* name;
@@ -46,10 +126,31 @@ struct type_member {
 	};
 };
 
+// lazily computed data
+
+struct type_cache {
+
+	int ndeps;
+	void** deps;
+
+	struct layout* layout;	// abi.c
+	struct enum_index* enm;	// enum.c
+	struct path_cache* paths;	// path.c
+	struct type_value_plan* value;	// value.c
+};
+
 struct type {
 
 	int refcount;
 	enum type_kind kind;
+	unsigned int props;
+	struct type_cache* cache;
+
+#ifdef TYPE_GC
+	struct type* gc_next;	// all collectable nodes
+	struct type* gc_prev;
+	unsigned int gc_epoch;	// of the last marking which reached it
+#endif
 
 	union {	
 		struct { 
@@ -58,6 +159,9 @@ struct type {
 			int n;
 			struct type_member* members;
 			bool vna;
+
+			int align;	// attributes
+			bool packed;
 		};
 
 		struct {
@@ -65,6 +169,11 @@ struct type {
 			int value;
 		};
 
+		struct {
+
+			int width;	// _BitInt
+		};
+
 		type referenced;
 
 		struct {
@@ -72,6 +181,7 @@ struct type {
 			unsigned int flags;
 			type base;
 			int bits;
+			int alignment;
 		};
 
 		struct {
@@ -90,88 +200,706 @@ struct type {
 	};
 };
 
+#ifdef TYPE_GC
+static void gc_link(struct type* t);
+static void gc_unlink(struct type* t);
+#endif
+
+#ifndef TYPE_DEBUG
+// Freed nodes are kept on a short per-thread list and handed out
+// again by type_alloc, so that tearing down one translation unit
+// and building the next does not go through malloc for every node.
+// The list is returned to malloc when the thread exits.
+
+enum { NODE_CACHE = 1024 };
+
+static _Thread_local struct {
+
+	struct type* first;	// linked through referenced
+	int n;
+
+} spare = { NULL, 0 };
+
+static pthread_once_t spare_once = PTHREAD_ONCE_INIT;
+static pthread_key_t spare_key;
+
+static void spare_drain(void* p)
+{
+	(void)p;
+
+	while (NULL != spare.first) {
+
+		struct type* t = spare.first;
+
+		spare.first = (struct type*)t->referenced;
+		xfree(t);
+	}
+
+	spare.n = 0;
+}
+
+static void spare_init(void)
+{
+	pthread_key_create(&spare_key, spare_drain);
+}
+
+static struct type* node_get(void)
+{
+	struct type* t = spare.first;
+
+	if (NULL == t)
+		return xmalloc(sizeof(struct type));
+
+	spare.first = (struct type*)t->referenced;
+	spare.n--;
+
+	return t;
+}
+
+static void node_put(struct type* t)
+{
+	if (NODE_CACHE <= spare.n) {
+
+		xfree(t);
+		return;
+	}
+
+	// the key only exists for its destructor
+
+	if (NULL == spare.first) {
+
+		pthread_once(&spare_once, spare_init);
+		pthread_setspecific(spare_key, &spare);
+	}
+
+	t->referenced = spare.first;
+	spare.first = t;
+	spare.n++;
+}
+#endif
+
 static struct type* type_alloc(enum type_kind k)
 {
-	struct type* t = xmalloc(sizeof(struct type));
+	unsigned long long start = TRACING() ? type_trace_clock() : 0;
+
+	struct type* t = NODE_GET();
+
+	STATS_NODE(k, 1);
+	STATS_BYTES(k, TYPE_MEM_NODES, sizeof(struct type));
+
 	t->kind = k;
 	t->refcount = 1;
+	t->props = 0;
+	t->cache = NULL;
+
+	DEBUG_ALLOC(t, k);
+	GC_LINK(t);
+
+	if (TRACING())
+		type_trace_event(TYPE_TRACE_ALLOC, k, start);
+
 	return t;
 }
 
+static unsigned int type_props(type t);
+
+
+// canonical nodes for the basic types and their unsigned and
+// complex variants, a negative refcount marks nodes which are
+// shared and never freed
+
+static struct type basic_types[TYPE_NR_KINDS][3];
+
+static bool basic_kind_p(enum type_kind kind)
+{
+	switch (kind) {
+
+	case TYPE_VOID:
+	case TYPE_BOOL:
+	case TYPE_CHAR:
+	case TYPE_SCHAR:
+	case TYPE_SHORT:
+	case TYPE_INT:
+	case TYPE_LONG:
+	case TYPE_LONGLONG:
+	case TYPE_FLOAT:
+	case TYPE_DOUBLE:
+	case TYPE_LONGDOUBLE:
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+static void basic_once(void)
+{
+	for (enum type_kind k = 0; k < TYPE_NR_KINDS; k++) {
+
+		if (!basic_kind_p(k))
+			continue;
+
+		struct type* t = &basic_types[k][0];
+
+		t->refcount = -1;
+		t->kind = k;
+		t->props = type_props(t);
+
+		for (int v = 1; v < 3; v++) {
+
+			struct type* m = &basic_types[k][v];
+
+			m->refcount = -1;
+			m->kind = TYPE_MODIFIED;
+			m->base = t;
+			m->flags = (1 == v) ? UNSIGNED : COMPLEX;
+			m->bits = 0;
+			m->alignment = 0;
+			m->props = type_props(m);
+		}
+	}
+}
+
+static void basic_init(void)
+{
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+	pthread_once(&once, basic_once);
+}
+
+static bool canonical_p(type t)
+{
+	return (t == &basic_types[t->kind][0]);
+}
+
 type type_basic(enum type_kind kind)
 {
-	type t = type_alloc(kind);
-//	assert(type_basic_p(t));
+	if (basic_kind_p(kind)) {
+
+		basic_init();
+		return &basic_types[kind][0];
+	}
+
+	struct type* t = type_alloc(kind);
+	t->props = type_props(t);
 	return t;
 }
 
 type type_void(void)
 {
-	return type_alloc(TYPE_VOID);
+	return type_basic(TYPE_VOID);
+}
+
+
+// canonical nodes for _BitInt(N) and its unsigned variant are
+// allocated in pairs on first use and interned by width in an
+// open addressing table (under a lock)
+
+static struct {
+
+	pthread_mutex_t lock;
+	int N;
+	int size;
+	struct type** slots;
+
+} bitints = { PTHREAD_MUTEX_INITIALIZER, 0, 0, NULL };
+
+static struct type** bitint_slot(struct type** slots, int size, int width)
+{
+	unsigned int h = (unsigned int)width * 2654435761u;
+
+	for (int i = h & (size - 1); ; i = (i + 1) & (size - 1))
+		if ((NULL == slots[i]) || (width == slots[i]->width))
+			return &slots[i];
+}
+
+type type_bitint(int N)
+{
+	assert((0 < N) && (N <= MAX_BITINT));
+
+	pthread_mutex_lock(&bitints.lock);
+
+	if (2 * (bitints.N + 1) > bitints.size) {
+
+		int size = (0 == bitints.size) ? 16 : 2 * bitints.size;
+		struct type** slots = xmalloc(size * sizeof(struct type*));
+
+		memset(slots, 0, size * sizeof(struct type*));
+
+		for (int i = 0; i < bitints.size; i++)
+			if (NULL != bitints.slots[i])
+				*bitint_slot(slots, size, bitints.slots[i]->width) = bitints.slots[i];
+
+		free(bitints.slots);
+
+		bitints.slots = slots;
+		bitints.size = size;
+	}
+
+	struct type** slot = bitint_slot(bitints.slots, bitints.size, N);
+
+	if (NULL == *slot) {
+
+		struct type* t = xmalloc(2 * sizeof(struct type));
+
+		STATS_NODE(TYPE_BITINT, 1);
+		STATS_NODE(TYPE_MODIFIED, 1);
+		STATS_BYTES(TYPE_BITINT, TYPE_MEM_NODES, sizeof(struct type));
+		STATS_BYTES(TYPE_MODIFIED, TYPE_MEM_NODES, sizeof(struct type));
+
+		t[0].refcount = -1;
+		t[0].kind = TYPE_BITINT;
+		t[0].cache = NULL;
+		t[0].width = N;
+		t[0].props = type_props(&t[0]);
+
+		t[1].refcount = -1;
+		t[1].kind = TYPE_MODIFIED;
+		t[1].cache = NULL;
+		t[1].base = &t[0];
+		t[1].flags = UNSIGNED;
+		t[1].bits = 0;
+		t[1].alignment = 0;
+		t[1].props = type_props(&t[1]);
+
+		*slot = t;
+		bitints.N++;
+	}
+
+	type t = *slot;
+
+	pthread_mutex_unlock(&bitints.lock);
+
+	return t;
 }
 
 type type_ref(type t)
 {
+	if (t->refcount < 0)
+		return t;
+
+	DEBUG_REF(t, +1);
+
 	((struct type*)t)->refcount++;
 	return t;
 }
 
-void type_free(type t)
-{
-	if (0 != --((struct type*)t)->refcount)
-		return;
+// children of a node in the graph as stored
 
+static int node_children(type t)
+{
 	switch (t->kind) {
 
 	case TYPE_POINTER:
+	case TYPE_ARRAY:
+	case TYPE_VECTOR:
+	case TYPE_MODIFIED:
+		return 1;
 
-       		type_free(t->referenced);
-		break;
+	case TYPE_FUNCTION:
+		return 2;
+
+	case TYPE_ARGLIST:
+	case TYPE_STRUCT:
+	case TYPE_UNION:
+		return t->n;
+
+	default:
+		return 0;
+	}
+}
+
+static type node_child(type t, int i)
+{
+	switch (t->kind) {
+
+	case TYPE_POINTER:
+		return t->referenced;
 
 	case TYPE_ARRAY:
+	case TYPE_VECTOR:
+		return t->element;
 
-		type_free(t->element);
-		break;
+	case TYPE_MODIFIED:
+		return t->base;
 
 	case TYPE_FUNCTION:
+		return (0 == i) ? t->ret : t->args;
 
-		type_free(t->ret);
-		type_free(t->args);
-		break;
+	default:
+		return t->members[i].typ;
+	}
+}
+
+// frees what a node owns except for the references to its children
+
+static void node_release(struct type* t)
+{
+	GC_UNLINK(t);
+
+	switch (t->kind) {
 
 	case TYPE_ARGLIST:
 	case TYPE_STRUCT:
 	case TYPE_UNION:
 	case TYPE_ENUM:
 
-		for (int i = 0; i < t->n; i++) {
-
-			if (TYPE_ENUM != t->kind)
-				type_free(t->members[i].typ);
+		for (int i = 0; i < t->n; i++)
+			name_free(t->kind, t->members[i].name);
 
-			xfree(t->members[i].name);
-		}
+		if (NULL != t->members)
+			STATS_BYTES(t->kind, TYPE_MEM_MEMBERS, -(long long)(t->n * sizeof(struct type_member)));
 
-		xfree(t->tag);
+		name_free(t->kind, t->tag);
 		xfree(t->members);
 		break;
 
-	case TYPE_MODIFIED:
-
-		type_free(t->base);
-		break;
-
 	default:
 		break;
 	}
 
-	xfree(t);
+	if (NULL != t->cache) {
+
+		if (NULL != t->cache->layout)
+			layout_free(t->cache->layout);
+
+		if (NULL != t->cache->enm)
+			enum_index_free(t->cache->enm);
+
+		if (NULL != t->cache->paths)
+			path_cache_free(t->cache->paths);
+
+		if (NULL != t->cache->value)
+			type_value_plan_free(t->cache->value);
+
+		xfree(t->cache->deps);
+		xfree(t->cache);
+
+		STATS_BYTES(t->kind, TYPE_MEM_CACHE, -(long long)sizeof(struct type_cache));
+	}
+
+	STATS_NODE(t->kind, -1);
+	STATS_BYTES(t->kind, TYPE_MEM_NODES, -(long long)sizeof(struct type));
+
+	NODE_FREE(t);
+}
+
+// Drops one reference and returns true if it was the last one.
+
+static bool node_unref(type t)
+{
+	if (t->refcount < 0)
+		return false;
+
+	DEBUG_REF(t, -1);
+
+	return (0 == --((struct type*)t)->refcount);
+}
+
+// Nodes whose last reference is gone wait on an explicit stack,
+// so that the depth of a graph does not matter. A node is only
+// pushed when its count drops to zero, which happens once, so
+// shared children are visited once however many roots reach them.
+
+void type_free_n(int N, const type ts[N])
+{
+	int size = 64;
+	int sp = 0;
+	type local[64];
+	type* stack = local;
+	int i = N;
+
+	// roots are taken last to first, which undoes the usual
+	// order of construction and keeps recently used nodes hot
+
+	while ((0 < sp) || (0 < i)) {
+
+		type t;
+
+		if (0 < sp)
+			t = stack[--sp];
+		else if (node_unref(ts[--i]))
+			t = ts[i];
+		else
+			continue;
+
+		int n = node_children(t);
+
+		for (int j = 0; j < n; j++) {
+
+			type c = node_child(t, j);
+
+			if (!node_unref(c))
+				continue;
+
+			if (sp == size) {
+
+				size *= 2;
+
+				type* nstack = xmalloc(size * sizeof(type));
+				memcpy(nstack, stack, sp * sizeof(type));
+
+				if (local != stack)
+					xfree(stack);
+
+				stack = nstack;
+			}
+
+			stack[sp++] = c;
+		}
+
+		node_release((struct type*)t);
+	}
+
+	if (local != stack)
+		xfree(stack);
+}
+
+void type_free(type t)
+{
+	type_free_n(1, &t);
+}
+
+
+#ifdef TYPE_GC
+
+// Mark-and-sweep collection of nodes which are not reachable from
+// the registered roots. All nodes which can be freed are linked
+// into a list. Marking stores the current epoch in each reachable
+// node, using an explicit stack. Sweeping then runs in steps over
+// the list in two passes: the first drops the references from
+// unreachable nodes to reachable ones, so that reference counts
+// stay correct, the second frees the unreachable nodes without
+// following their children (which are either reachable or freed
+// in the same pass). Nodes allocated during sweeping are inserted
+// in front of the cursor and marked as reachable.
+
+enum gc_phase { GC_IDLE, GC_DROP, GC_FREE };
+
+static struct {
+
+	pthread_mutex_t lock;
+	struct type* first;
+	unsigned int epoch;
+
+	enum gc_phase phase;
+	struct type* cursor;
+	size_t freed;
+
+	int nroots;
+	int size;
+	type* roots;
+
+} gc = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static void gc_link(struct type* t)
+{
+	pthread_mutex_lock(&gc.lock);
+
+	t->gc_epoch = gc.epoch;
+	t->gc_prev = NULL;
+	t->gc_next = gc.first;
+
+	if (NULL != gc.first)
+		gc.first->gc_prev = t;
+
+	gc.first = t;
+
+	pthread_mutex_unlock(&gc.lock);
+}
+
+static void gc_unlink(struct type* t)
+{
+	pthread_mutex_lock(&gc.lock);
+
+	if (gc.cursor == t)
+		gc.cursor = t->gc_next;
+
+	if (NULL != t->gc_prev)
+		t->gc_prev->gc_next = t->gc_next;
+	else
+		gc.first = t->gc_next;
+
+	if (NULL != t->gc_next)
+		t->gc_next->gc_prev = t->gc_prev;
+
+	pthread_mutex_unlock(&gc.lock);
+}
+
+void type_gc_root(type t)
+{
+	if (t->refcount < 0)
+		return;
+
+	if (gc.nroots == gc.size) {
+
+		gc.size = (0 == gc.size) ? 16 : 2 * gc.size;
+		gc.roots = realloc(gc.roots, gc.size * sizeof(type));
+
+		if (NULL == gc.roots)
+			abort();
+	}
+
+	gc.roots[gc.nroots++] = t;
+}
+
+void type_gc_unroot(type t)
+{
+	if (t->refcount < 0)
+		return;
+
+	for (int i = gc.nroots - 1; i >= 0; i--) {
+
+		if (t == gc.roots[i]) {
+
+			gc.roots[i] = gc.roots[--gc.nroots];
+			return;
+		}
+	}
+
+	assert(0);
+}
+
+static bool live_p(type t)
+{
+	return (t->refcount < 0) || (gc.epoch == t->gc_epoch);
 }
 
+void type_gc_start(void)
+{
+	assert(GC_IDLE == gc.phase);
+
+	gc.epoch++;
+
+	int size = 64;
+	int sp = 0;
+	type* stack = xmalloc(size * sizeof(type));
+
+	for (int r = 0; r < gc.nroots; r++) {
+
+		type t = gc.roots[r];
+
+		if (live_p(t))
+			continue;
+
+		((struct type*)t)->gc_epoch = gc.epoch;
+		stack[sp++] = t;
+
+		while (0 < sp) {
+
+			type n = stack[--sp];
+
+			for (int i = 0; i < node_children(n); i++) {
+
+				type c = node_child(n, i);
+
+				if ((NULL == c) || live_p(c))
+					continue;
+
+				((struct type*)c)->gc_epoch = gc.epoch;
+
+				if (sp == size) {
+
+					size *= 2;
+					stack = realloc(stack, size * sizeof(type));
+
+					if (NULL == stack)
+						abort();
+				}
+
+				stack[sp++] = c;
+			}
+		}
+	}
+
+	free(stack);
+
+	gc.phase = GC_DROP;
+	gc.cursor = gc.first;
+	gc.freed = 0;
+}
+
+bool type_gc_step(size_t budget)
+{
+	while ((GC_IDLE != gc.phase) && (0 < budget--)) {
+
+		struct type* t = gc.cursor;
+
+		if (NULL == t) {
+
+			gc.phase = (GC_DROP == gc.phase) ? GC_FREE : GC_IDLE;
+			gc.cursor = gc.first;
+			continue;
+		}
+
+		gc.cursor = t->gc_next;
+
+		if (live_p(t))
+			continue;
+
+		if (GC_DROP == gc.phase) {
+
+			for (int i = 0; i < node_children(t); i++) {
+
+				struct type* c = (struct type*)node_child(t, i);
+
+				if ((NULL != c) && (0 < c->refcount) && live_p(c))
+					c->refcount--;
+			}
+
+		} else {
+
+			node_release(t);
+			gc.freed++;
+		}
+	}
+
+	return (GC_IDLE == gc.phase);
+}
+
+size_t type_gc_collect(void)
+{
+	type_gc_start();
+
+	while (!type_gc_step((size_t)-1))
+		;
+
+	return gc.freed;
+}
+
+#else
+
+void type_gc_root(type t)
+{
+	(void)t;
+}
+
+void type_gc_unroot(type t)
+{
+	(void)t;
+}
+
+void type_gc_start(void)
+{
+}
+
+bool type_gc_step(size_t budget)
+{
+	(void)budget;
+	return true;
+}
+
+size_t type_gc_collect(void)
+{
+	return 0;
+}
+
+#endif
+
 type type_pointer(type t)
 {
 	struct type* n = type_alloc(TYPE_POINTER);
 	n->referenced = t;
+	n->props = type_props(n);
 	return n;
 }
 
@@ -181,6 +909,7 @@ type type_array(int N, type t)
 	n->length = N;
 	n->element = t;
 	n->targ = NULL;
+	n->props = type_props(n);
 	return n;
 }
 
@@ -190,6 +919,23 @@ type type_incomplete_array(type t)
 	n->length = -1;
 	n->element = t;
 	n->targ = NULL;
+	n->props = type_props(n);
+	return n;
+}
+
+// GCC vector extension, the element is a real arithmetic type
+// and the number of lanes a power of two
+
+type type_vector(int lanes, type t)
+{
+	assert((0 < lanes) && (0 == (lanes & (lanes - 1))));
+	assert(type_arithmetic_p(t) && !type_complex_p(t) && !type_bitfield_p(t));
+
+	struct type* n = type_alloc(TYPE_VECTOR);
+	n->length = lanes;
+	n->element = t;
+	n->targ = NULL;
+	n->props = type_props(n);
 	return n;
 }
 
@@ -199,6 +945,7 @@ type type_variable_array(type t, void* targ)
 	n->length = -2;
 	n->element = t;
 	n->targ = targ;
+	n->props = type_props(n);
 	return n;
 }
 
@@ -207,16 +954,19 @@ type type_arglist(int N, type args[N], const char* names[N])
 	struct type* n = type_alloc(TYPE_ARGLIST);
 
 	n->tag = NULL;
-	n->members = xmalloc(N * sizeof(struct type_element));
+	n->members = xmalloc(N * sizeof(struct type_member));
+
+	STATS_BYTES(TYPE_ARGLIST, TYPE_MEM_MEMBERS, N * sizeof(struct type_member));
 
 	for (int i = 0; i < N; i++) {
 
 		n->members[i].typ = args[i];
-		n->members[i].name = names[i];
+		n->members[i].name = name_dup(TYPE_ARGLIST, names[i]);
 	}
 
 	n->n = N;
 	n->vna = false;
+	n->props = type_props(n);
 
 	return n;
 }
@@ -227,6 +977,7 @@ type type_function2(type ret, int N, type args[N], const char* names[N])
 
 	n->ret = ret;
 	n->args = type_arglist(N, args, names);
+	n->props = type_props(n);
 
 	return n;
 }
@@ -241,66 +992,113 @@ type type_function(type ret, int N, type args[N])
 	return type_function2(ret, N, args, names);
 }
 
-static struct type* type_compound(const char* tag, int N, struct type_element e[N])
+static void compound_members(struct type* n, int N, struct type_element e[N])
 {
-	struct type* n = type_alloc(TYPE_VOID);
-
 	n->n = N;
-	n->tag = strdup(tag);
-	n->members = NULL;
-
-	if (NULL == e) { // incomplete
-
-		assert(0 == N);
-		return n;
-	}
-	
 	n->members = xmalloc(N * sizeof(struct type_member));
 
+	STATS_BYTES(n->kind, TYPE_MEM_MEMBERS, N * sizeof(struct type_member));
+
 	for (int i = 0; i < N; i++) {
 
-		n->members[i].name = strdup(e[i].name);
+		n->members[i].name = name_dup(n->kind, e[i].name);
 		n->members[i].typ = e[i].typ;
 	}
+}
+
+static struct type* type_compound(enum type_kind kind, const char* tag, int N, struct type_element e[N])
+{
+	struct type* n = type_alloc(kind);
+
+	n->n = 0;
+	n->tag = name_dup(kind, tag);
+	n->members = NULL;
+	n->align = 0;
+	n->packed = false;
+
+	if (NULL == e) // incomplete
+		assert(0 == N);
+	else
+		compound_members(n, N, e);
+
+	n->props = type_props(n);
 
 	return n;
 }
 
 type type_struct(const char* tag, int N, struct type_element e[N])
 {
-	struct type* n = type_compound(tag, N, e);
-	n->kind = TYPE_STRUCT;
+	return type_compound(TYPE_STRUCT, tag, N, e);
+}
+
+// with alignment (zero for none) and packing attributes
+
+// a bit-field of a packed struct may start at any bit, it has to
+// fit into the eight bytes it spans at most (abi_bitfield_pos)
+
+static bool packed_bitfields_p(int N, struct type_element e[N])
+{
+	for (int i = 0; i < N; i++)
+		if (type_bitfield_p(e[i].typ) && (type_bitfield_bits(e[i].typ) > 64 - (CHAR_BIT - 1)))
+			return false;
+
+	return true;
+}
+
+type type_struct2(const char* tag, int N, struct type_element e[N], int align, bool packed)
+{
+	assert((0 <= align) && (0 == (align & (align - 1))));
+	assert(!packed || packed_bitfields_p(N, e));
+
+	struct type* n = type_compound(TYPE_STRUCT, tag, N, e);
+	n->align = align;
+	n->packed = packed;
 	return n;
 }
 
 type type_struct_inc(const char* tag)
 {
-	struct type* n = type_compound(tag, 0, NULL);
-	n->kind = TYPE_STRUCT;
-	return n;
+	return type_compound(TYPE_STRUCT, tag, 0, NULL);
 }
 
 
 type type_union(const char* tag, int N, struct type_element e[N])
 {
-	struct type* n = type_compound(tag, N, e);
-	n->kind = TYPE_UNION;
-	return n;
+	return type_compound(TYPE_UNION, tag, N, e);
 }
 
-type type_union_inc(const char* tag)
+type type_union2(const char* tag, int N, struct type_element e[N], int align, bool packed)
 {
-	struct type* n = type_compound(tag, 0, NULL);
-	n->kind = TYPE_UNION;
+	assert((0 <= align) && (0 == (align & (align - 1))));
+
+	struct type* n = type_compound(TYPE_UNION, tag, N, e);
+	n->align = align;
+	n->packed = packed;
 	return n;
 }
 
-type type_enum(const char* tag, int N, struct type_enum e[N])
+type type_union_inc(const char* tag)
 {
-	struct type* n = type_compound(tag, 0, NULL);
+	return type_compound(TYPE_UNION, tag, 0, NULL);
+}
 
+static void enum_members(struct type* n, int N, struct type_enum e[N])
+{
 	n->n = N;
-	n->kind = TYPE_ENUM;
+	n->members = xmalloc(N * sizeof(struct type_member));
+
+	STATS_BYTES(TYPE_ENUM, TYPE_MEM_MEMBERS, N * sizeof(struct type_member));
+
+	for (int i = 0; i < N; i++) {
+
+		n->members[i].name = name_dup(TYPE_ENUM, e[i].name);
+		n->members[i].value = e[i].value;
+	}
+}
+
+type type_enum(const char* tag, int N, struct type_enum e[N])
+{
+	struct type* n = type_compound(TYPE_ENUM, tag, 0, NULL);
 
 	if (NULL == e) { // incomplete
 
@@ -308,23 +1106,86 @@ type type_enum(const char* tag, int N, struct type_enum e[N])
 		return n;
 	}
 
-	n->members = xmalloc(N * sizeof(struct type_member));
+	enum_members(n, N, e);
+	n->props = type_props(n);
 
-	for (int i = 0; i < N; i++) {
+	return n;
+}
 
-		n->members[i].name = strdup(e[i].name);
-		n->members[i].value = e[i].value;
+
+type type_enum_inc(const char* tag)
+{
+	return type_compound(TYPE_ENUM, tag, 0, NULL);
+}
+
+
+// Completion fills in the members of an incomplete node, so that
+// all earlier references to it (pointers, declarations) see the
+// definition. Nodes derived from it are marked as pending and
+// compute completeness and size properties when asked instead of
+// using the value stored at construction. Cached data of the node
+// itself is dropped. Completion must not race with other uses of
+// the node. A member referring back to the node itself creates a
+// cycle of references, which only the collector (TYPE_GC) frees.
+
+static struct type* completion(type t, enum type_kind kind)
+{
+	assert(kind == t->kind);
+	assert(NULL == t->members);
+
+	struct type* n = (struct type*)t;
+
+	if (NULL != n->cache) {
+
+		if (NULL != n->cache->layout)
+			layout_free(n->cache->layout);
+
+		if (NULL != n->cache->enm)
+			enum_index_free(n->cache->enm);
+
+		if (NULL != n->cache->paths)
+			path_cache_free(n->cache->paths);
+
+		if (NULL != n->cache->value)
+			type_value_plan_free(n->cache->value);
+
+		n->cache->layout = NULL;
+		n->cache->enm = NULL;
+		n->cache->paths = NULL;
+		n->cache->value = NULL;
 	}
 
 	return n;
 }
 
+void type_complete(type t, int N, struct type_element e[N])
+{
+	assert((TYPE_STRUCT == t->kind) || (TYPE_UNION == t->kind));
 
-type type_enum_inc(const char* tag)
+	struct type* n = completion(t, t->kind);
+
+	compound_members(n, N, e);
+	n->props = type_props(n);
+}
+
+void type_complete2(type t, int N, struct type_element e[N], int align, bool packed)
 {
-	struct type* n = type_compound(tag, 0, NULL);
-	n->kind = TYPE_ENUM;
-	return n;
+	assert((0 <= align) && (0 == (align & (align - 1))));
+	assert(!packed || (TYPE_UNION == t->kind) || packed_bitfields_p(N, e));
+
+	type_complete(t, N, e);
+
+	struct type* n = (struct type*)t;
+	n->align = align;
+	n->packed = packed;
+}
+
+void type_enum_complete(type t, int N, struct type_enum e[N])
+{
+	struct type* n = completion(t, TYPE_ENUM);
+
+	enum_members(n, N, e);
+	n->props = type_props(n);
 }
 
 
@@ -344,15 +1205,25 @@ static struct type* type_modify(type t, unsigned int flags)
 
 	if (TYPE_MODIFIED == t->kind) {
 
-		n->base = t->base;
+		// the modified node is replaced
+
+		n->base = type_ref(t->base);
 		n->flags = t->flags | flags;
+		n->bits = t->bits;
+		n->alignment = t->alignment;
+
+		type_free(t);
 
 	} else {
 
 		n->base = t;
 		n->flags = flags;
+		n->bits = 0;
+		n->alignment = 0;
 	}
 
+	n->props = type_props(n);
+
 	return n;
 }
 
@@ -361,12 +1232,22 @@ type type_unsigned(type t)
 	if (type_unsigned_p(t))
 		return t;
 
+	if (canonical_p(t))
+		return &basic_types[t->kind][1];
+
+	if (TYPE_BITINT == t->kind)
+		return t + 1;
+
 	return type_modify(t, UNSIGNED);
 }
 
 type type_complex(type t)
 {
 	assert(type_float_p(t));
+
+	if (canonical_p(t))
+		return &basic_types[t->kind][2];
+
 	return type_modify(t, COMPLEX);
 }
 
@@ -382,19 +1263,60 @@ type type_bitfield(type t, int bits)
 	return t2;
 }
 
+// the declared type of a bit-field with its signedness and
+// qualifiers (returns a new reference)
+
+type type_bitfield_type(type t)
+{
+	assert(type_bitfield_p(t));
+
+	unsigned int flags = type_flags(t) & ~BITFIELD;
+	type b = type_ref(t->base);
+
+	if (flags & UNSIGNED) {
+
+		b = type_unsigned(b);
+		flags &= ~UNSIGNED;
+	}
+
+	if (0 == flags)
+		return b;
+
+	struct type* n = type_modify(b, flags);
+	n->alignment = t->alignment;
+
+	return n;
+}
+
+// _Alignas, the strictest alignment wins
+
+type type_aligned(type t, int align)
+{
+	assert((0 < align) && (0 == (align & (align - 1))));
+
+	struct type* t2 = type_modify(t, ALIGNED);
+
+	if (t2->alignment < align)
+		t2->alignment = align;
+
+	return t2;
+}
+
+// returns a new reference
+
 type type_unqualified(type t)
 {
 	int flags = type_flags(t);
 
 	if (0 == flags)
-		return t;
+		return type_ref(t);
 
-	flags &= ~(CONST|VOLATILE|RESTRICT|WIDE);
+	flags &= ~QUALIFIERS;
 
 	if (0 == flags)
-		return t->base;
+		return type_ref(t->base);
 
-	return type_modify(t->base, flags);
+	return type_modify(type_ref(t->base), flags);
 }
 
 type type_const(type t)
@@ -441,17 +1363,8 @@ type type_real(type t)
 }
 
 bool type_float_p(type t)
-{
-	switch (type_classify(t)) {
-
-	case TYPE_FLOAT:
-	case TYPE_DOUBLE:
-	case TYPE_LONGDOUBLE:
-		return true;
-
-	default:
-		return false;
-	}
+{
+	return (t->props & P_FLOAT);
 }
 
 bool type_real_p(type t)
@@ -500,33 +1413,17 @@ bool type_bitfield_p(type t)
 
 bool type_unsigned_p(type t)
 {
-	return (   (TYPE_BOOL == type_classify(t))
-	 	|| (type_signed_p(type_base(t)) 
-		    && (type_flags(t) & UNSIGNED)));
+	return (t->props & P_UNSIGNED);
 }
 
 bool type_signed_p(type t)
 {
-	if (type_flags(t) & UNSIGNED)
-		return false;
-
-	switch (type_base(t)->kind) {
-
-	case TYPE_SCHAR:
-	case TYPE_SHORT:
-	case TYPE_INT:
-	case TYPE_LONG:
-	case TYPE_LONGLONG:
-		return true;
-
-	default:
-		return false;
-	}
+	return (t->props & P_SIGNED);
 }
 
 bool type_scalar_p(type t)
 {
-	return (type_pointer_p(t) || type_arithmetic_p(t));
+	return (t->props & P_SCALAR);
 }
 
 bool type_aggregate_p(type t)
@@ -562,121 +1459,139 @@ bool type_struct_has_fam_p(type t)
 	return false;
 }
 
-bool type_known_const_size_p(type t)
+// properties of pending nodes may have changed by completion,
+// once nothing below is pending any more they are final and are
+// stored back (any thread computes the same value)
+
+static unsigned int props(type t)
 {
-	if (!type_complete_p(t))
-		return false;
+	unsigned int p = __atomic_load_n(&t->props, __ATOMIC_RELAXED);
 
-	if (type_compound_p(t)) {
+	if (0 == (p & P_PENDING))
+		return p;
 
-		int N = type_member_count(t);
+	p = type_props(t);
 
-		for (int i = 0; i < N; i++)
-			if (!type_known_const_size_p(type_member_type(t, i)))
-				return false;
-	}
+	if (0 == (p & P_PENDING))
+		__atomic_store_n(&((struct type*)t)->props, p, __ATOMIC_RELAXED);
 
-	if (   type_array_p(t)
-	    && (   type_array_vla_p(t)
-	        || (!type_known_const_size_p(type_array_element(t)))))
-		return false;
+	return p;
+}
 
-	return true;
+bool type_known_const_size_p(type t)
+{
+	return (props(t) & P_CONST_SIZE);
 }
 
 
-static void walk(type t, bool (*fun)(type x))
+static struct type_cache* type_cache(type t)
 {
-	if (!fun(t))
-		return;
-
-	switch (type_classify(t)) {
+	if (NULL == t->cache) {
 
-	case TYPE_FUNCTION:
+		struct type_cache* c = xmalloc(sizeof(struct type_cache));
 
-		walk(type_function_return(t), fun);
+		STATS_BYTES(t->kind, TYPE_MEM_CACHE, sizeof(struct type_cache));
 
-		//t = type_function_arguments(t);
+		c->ndeps = -1;
+		c->deps = NULL;
+		c->layout = NULL;
+		c->enm = NULL;
+		c->paths = NULL;
+		c->value = NULL;
 
-		break;
+		((struct type*)t)->cache = c;
+	}
 
-	case TYPE_STRUCT:
-	case TYPE_UNION:
+	return t->cache;
+}
 
-		;
-#if 0
-		int N = type_member_count(t);
+struct layout** type_layout_cache(type t)
+{
+	return &type_cache(type_base(t))->layout;
+}
 
-		for (int i = 0; i < N; i++)
-			walk(type_member_type(t, i), fun);
-#endif
-		break;
+struct enum_index** type_enum_cache(type t)
+{
+	return &type_cache(type_base(t))->enm;
+}
 
-	case TYPE_POINTER:
+struct path_cache** type_path_cache(type t)
+{
+	return &type_cache(type_base(t))->paths;
+}
 
-		walk(type_pointer_referenced(t), fun);
+struct type_value_plan** type_value_cache(type t)
+{
+	return &type_cache(type_base(t))->value;
+}
 
-		break;
 
-	case TYPE_ARRAY:
+bool type_variably_modified_p(type t)
+{
+	return (t->props & P_VM);
+}
 
-		walk(type_array_element(t), fun);
 
-		break;
+// VLA size expressions a type depends on in pre-order, collected
+// once and cached in the node. Members of (GNU) structs with
+// variably modified members are entered, arguments are not.
 
-	default:
-		;
-	}
-}
+static enum type_visit dependency(void* ctx, type t)
+{
+	struct type_cache* c = ctx;
 
+	if (!type_variably_modified_p(t))
+		return TYPE_VISIT_SKIP;
 
-int type_dependencies(type t)
-{
-	int d = 0;
+	if (type_array_vla_p(t)) {
 
-	bool fun(type t)
-	{
-		if (type_compound_p(t))
-			return false;
+		if (0 == (c->ndeps & (c->ndeps - 1)))
+			c->deps = realloc(c->deps, (c->ndeps ? 2 * c->ndeps : 1) * sizeof(void*));
 
-		if (   type_array_p(t)
-		    && type_array_vla_p(t))
-			d += 1;
+		if (NULL == c->deps)
+			abort();
 
-		return true;
+		c->deps[c->ndeps++] = type_base(t)->targ;
 	}
 
-	walk(t, fun);
-
-	return d;
+	return TYPE_VISIT_CONTINUE;
 }
 
-void* type_get_dependency(type t, int n)
+void* const* type_dependency_list(type t, int* n)
 {
-	int d = 0;
-	void* ptr = NULL;
-
-	bool fun(type t)
-	{
-		if (type_compound_p(t))
-			return false;
+	*n = 0;
 
-		if (   type_array_p(t)
-		    && type_array_vla_p(t)) {
+	if (!type_variably_modified_p(t))
+		return NULL;
 
-			if (n == d++) {
+	struct type_cache* c = type_cache(type_base(t));
 
-				ptr = t->targ;
-				return false;
-			}
-		}
+	if (-1 == c->ndeps) {
 
-		return true;
+		c->ndeps = 0;
+		type_visit(type_base(t), TYPE_VISIT_MEMBERS, dependency, NULL, c);
 	}
 
-	walk(t, fun);
+	*n = c->ndeps;
+
+	return c->deps;
+}
+
+int type_dependencies(type t)
+{
+	int n;
+	type_dependency_list(t, &n);
+	return n;
+}
+
+void* type_get_dependency(type t, int n)
+{
+	int N;
+	void* const* deps = type_dependency_list(t, &N);
+
+	assert((0 <= n) && (n < N));
 
-	return ptr;
+	return deps[n];
 }
 
 bool type_derived_decl_p(type t)
@@ -696,6 +1611,7 @@ enum type_category type_category(type t)
 	case TYPE_POINTER: return TC_POINTER;
 	case TYPE_ARRAY: return TC_ARRAY;
 	case TYPE_FUNCTION: return TC_FUNCTION;
+	case TYPE_VECTOR: return TC_VECTOR;
 
 	default: break;
 	}
@@ -715,47 +1631,25 @@ bool type_qualified_p(type t)
 
 bool type_character_p(type t)
 {
-	return ((TYPE_CHAR == type_classify(t))
-		|| (TYPE_SCHAR == type_classify(t)));
+	return (t->props & P_CHARACTER);
 }
 
 bool type_integer_p(type t)
 {
-	return (type_enum_p(t) || type_signed_p(t) || type_unsigned_p(t) || type_character_p(t));
+	return (t->props & P_INTEGER);
 }
 
 bool type_basic_p(type t)
 {
-	return ((TYPE_CHAR == type_classify(t))
-		|| type_signed_p(t) 
-		|| type_unsigned_p(t)
-		|| type_float_p(t));
+	return (t->props & P_BASIC);
 }
 
 bool type_arithmetic_p(type t)
 {
-	return type_integer_p(t) || type_float_p(t);;
+	return (t->props & P_ARITHMETIC);
 }
 
 
-int type_rank(type t)
-{
-	assert(type_integer_p(t));
-
-	switch (type_classify(t)) {
-
-	case TYPE_BOOL: return 1;
-	case TYPE_CHAR: return 2;
-	case TYPE_SCHAR: return 2;
-	case TYPE_SHORT: return 3;
-	case TYPE_ENUM:
-	case TYPE_INT: return 4;
-	case TYPE_LONG: return 5;
-	case TYPE_LONGLONG: return 6;
-
-	default: assert(0);
-	}
-}
 
 
 type type_promote(type t)
@@ -789,34 +1683,157 @@ type type_promote(type t)
 
 bool type_complete_p(type t)
 {
-	if (type_basic_p(t))
-		return true;
+	return (props(t) & P_COMPLETE);
+}
 
-	switch (type_classify(t)) {
+
+// classification of a node from its kind, flags and the
+// (already computed) properties of the nodes it refers to
+
+static unsigned int type_props(type t)
+{
+	type b = type_base(t);
+	unsigned int p = 0;
+
+	switch (b->kind) {
+
+	case TYPE_BOOL:
+		p |= P_UNSIGNED;
+		break;
+
+	case TYPE_SCHAR:
+		p |= P_CHARACTER;
+		// fall through
+
+	case TYPE_SHORT:
+	case TYPE_INT:
+	case TYPE_LONG:
+	case TYPE_LONGLONG:
+	case TYPE_BITINT:
+		p |= (type_flags(t) & UNSIGNED) ? P_UNSIGNED : P_SIGNED;
+		break;
+
+	case TYPE_CHAR:
+		p |= P_CHARACTER | P_BASIC;
+
+		if (type_flags(t) & UNSIGNED)
+			p |= P_UNSIGNED;
+
+		break;
+
+	case TYPE_FLOAT:
+	case TYPE_DOUBLE:
+	case TYPE_LONGDOUBLE:
+		p |= P_FLOAT;
+		break;
+
+	case TYPE_ENUM:
+		p |= P_INTEGER;
+		break;
+
+	case TYPE_POINTER:
+		p |= P_SCALAR;
+		break;
+
+	default:
+		break;
+	}
+
+	if (p & (P_SIGNED | P_UNSIGNED | P_CHARACTER))
+		p |= P_INTEGER;
+
+	if (p & (P_SIGNED | P_UNSIGNED | P_FLOAT))
+		p |= P_BASIC;
+
+	if (p & (P_INTEGER | P_FLOAT))
+		p |= P_ARITHMETIC | P_SCALAR;
+
+	if (t != b)
+		return p | (props(b) & (P_COMPLETE | P_CONST_SIZE | P_VM | P_PENDING));
+
+	switch (b->kind) {
 
 	case TYPE_VOID:
-		return false;
+		break;
+
+	case TYPE_POINTER:
+
+		p |= P_COMPLETE | P_CONST_SIZE | (b->referenced->props & P_VM);
+		break;
+
+	case TYPE_FUNCTION:
+
+		p |= P_COMPLETE | P_CONST_SIZE | (b->ret->props & P_VM);
+		break;
 
 	case TYPE_ARRAY:
-		return !(-1 == type_base(t)->length);
+
+		p |= props(b->element) & (P_VM | P_PENDING);
+
+		if (-2 == b->length)
+			p |= P_VM;
+
+		if (-1 == b->length)
+			break;
+
+		p |= P_COMPLETE;
+
+		if ((-2 != b->length) && type_known_const_size_p(b->element))
+			p |= P_CONST_SIZE;
+
+		break;
 
 	case TYPE_STRUCT:
 	case TYPE_UNION:
-		return (NULL != type_base(t)->members);
 
-	default: break;
-	};
-	
-	return true;
+		if (NULL == b->members) {
+
+			p |= P_PENDING;
+			break;
+		}
+
+		p |= P_COMPLETE | P_CONST_SIZE;
+
+		for (int i = 0; i < b->n; i++) {
+
+			if (!type_known_const_size_p(b->members[i].typ))
+				p &= ~P_CONST_SIZE;
+
+			p |= props(b->members[i].typ) & (P_VM | P_PENDING);
+		}
+
+		break;
+
+	case TYPE_ENUM:
+
+		if (NULL == b->members)
+			p |= P_PENDING;
+		else
+			p |= P_COMPLETE | P_CONST_SIZE;
+
+		break;
+
+	default:
+		p |= P_COMPLETE | P_CONST_SIZE;
+		break;
+	}
+
+	return p;
 }
 
 
-bool type_identical_p(type a, type b)
+// flags in 'ignore' are only ignored at the top level
+
+static bool identical_p(type a, type b, unsigned int ignore)
 {
 	if (a == b)
 		return true;
 
-	if (type_flags(a) != type_flags(b))
+	if (0 != ((type_flags(a) ^ type_flags(b)) & ~ignore))
+		return false;
+
+	if (   type_aligned_p(a)
+	    && (type_aligned_bytes(a) != type_aligned_bytes(b)))
 		return false;
 
 	if (type_classify(a) != type_classify(b))
@@ -848,11 +1865,18 @@ bool type_identical_p(type a, type b)
 	case TC_UNION:
 		return false;
 
+	case TC_VECTOR:
+		return (   (type_vector_lanes(a) == type_vector_lanes(b))
+			&& type_identical_p(type_vector_element(a), type_vector_element(b)));
+
 	case TC_ATOMIC:
 		return (type_identical_p(type_base(a), type_base(b)));
 
 	case TC_SELF:
 
+		if (type_bitint_p(a))
+			return (type_bitint_width(a) == type_bitint_width(b));
+
 		if (type_arglist_p(a)) {
 
 			if (type_member_count(a) != type_member_count(b))
@@ -874,6 +1898,11 @@ bool type_identical_p(type a, type b)
 	return true;
 }
 
+bool type_identical_p(type a, type b)
+{
+	return identical_p(a, b, 0);
+}
+
 
 
 struct pair {
@@ -883,10 +1912,15 @@ struct pair {
 	const struct pair* link;
 };
 
-static bool type_compatible_inner(type a, type b, const struct pair* v);
+static bool type_compatible_inner(type a, type b, const struct pair* v, unsigned int ignore);
 
 static bool struct_compatible_p(type a, type b, const struct pair* v)
 {
+	// qualifiers were checked by the caller
+
+	a = type_base(a);
+	b = type_base(b);
+
 	const struct pair v2 = { a, b, v };
 
 	// pair seen before -> assume equivalence
@@ -899,10 +1933,17 @@ static bool struct_compatible_p(type a, type b, const struct pair* v)
 	if (0 != strcmp(a->tag, b->tag))
 		return false;
 
-	if (   (!type_complete_p(a))	// FIXME: we should record a constraint
+	// a declaration is compatible with any definition of the same
+	// tag 6.2.7(1), nodes completed later are compared by members
+
+	if (   (!type_complete_p(a))
 	    || (!type_complete_p(b)))
 		return true;
 
+	if (   (type_compound_align(a) != type_compound_align(b))
+	    || (type_compound_packed_p(a) != type_compound_packed_p(b)))
+		return false;
+
 	if (a->n != b->n)
 		return false;
 
@@ -910,20 +1951,39 @@ static bool struct_compatible_p(type a, type b, const struct pair* v)
 		if (   (0 != strcmp(a->members[i].name,
 				    b->members[i].name))
 		    || !type_compatible_inner(a->members[i].typ,
-					      b->members[i].typ, &v2))
+					      b->members[i].typ, &v2, 0))
 			return false;
 
 	return true;
 }
 
 
-static bool type_compatible_inner(type a, type b, const struct pair* v)
+static bool type_compatible_inner(type a, type b, const struct pair* v, unsigned int ignore)
 {
-	if (type_identical_p(a, b))
+	if (identical_p(a, b, ignore))
 		return true;
 
+	// an enum is compatible with its underlying type 6.7.2.2(4)
+
+	if (type_enum_p(a) != type_enum_p(b)) {
+
+		if (!type_enum_p(a)) {
+
+			type tmp = a;
+			a = b;
+			b = tmp;
+		}
+
+		type u = type_enum_underlying(a);
+
+		return (0 == ((type_flags(a) ^ (type_flags(b) & ~UNSIGNED)) & ~ignore))
+			&& (!type_bitfield_p(a) || (type_bitfield_bits(a) == type_bitfield_bits(b)))
+			&& (type_classify(b) == type_classify(u))
+			&& (type_unsigned_p(b) == type_unsigned_p(u));
+	}
+
 	// also takes care of qualifiers 6.7.2.4(10)
-	if (type_flags(a) != type_flags(b))
+	if (0 != ((type_flags(a) ^ type_flags(b)) & ~ignore))
 		return false;
 
 	if (   type_bitfield_p(a)
@@ -951,8 +2011,10 @@ static bool type_compatible_inner(type a, type b, const struct pair* v)
 
 	case TC_FUNCTION: { // 6.7.6.3(15)
 	
-		if (!type_compatible_p(type_unqualified(type_function_return(a)),
-				       type_unqualified(type_function_return(b))))
+		// qualifiers of the return type and of parameters are
+		// ignored without building unqualified nodes
+
+		if (!type_compatible_inner(type_function_return(a), type_function_return(b), v, QUALIFIERS))
 			return false;
 
 		type argsa = type_function_arguments(a);
@@ -965,8 +2027,7 @@ static bool type_compatible_inner(type a, type b, const struct pair* v)
 			return false;
 
 		for (int i = 0; i < argsa->n; i++)
-			if (!type_compatible_p(type_unqualified(type_member_type(argsa, i)),
-					       type_unqualified(type_member_type(argsb, i))))
+			if (!type_compatible_inner(type_member_type(argsa, i), type_member_type(argsb, i), v, QUALIFIERS))
 				return false;
 
 		return true;
@@ -979,24 +2040,13 @@ static bool type_compatible_inner(type a, type b, const struct pair* v)
 		// NOTE: C makes them non-compatible depending on scope, translation unit
 		return (0 == strcmp(type_compound_tag(a), type_compound_tag(b)));
 
+	case TC_VECTOR:
+		// elements are basic types, so only identical vectors are compatible
+		return false;
+
 	case TC_ATOMIC:
 	case TC_POINTER:
 	case TC_SELF:
-
-		if (type_enum_p(a) || type_enum_p(b)) {
-
-			if (!type_enum_p(a)) {
-
-				type tmp = a;
-				a = b;
-				b = tmp;
-			}
-
-			if (type_compatible_p(b, type_basic(TYPE_INT))) // pick int to be the compatible type
-				return true;
-			
-			return false;
-		}
 		break;
 	}
 
@@ -1005,7 +2055,16 @@ static bool type_compatible_inner(type a, type b, const struct pair* v)
 
 bool type_compatible_p(type a, type b)
 {
-	return type_compatible_inner(a, b, NULL);
+	if (!TRACING())
+		return type_compatible_inner(a, b, NULL, 0);
+
+	unsigned long long start = type_trace_clock();
+
+	bool r = type_compatible_inner(a, b, NULL, 0);
+
+	type_trace_event(TYPE_TRACE_COMPATIBLE, type_classify(a), start);
+
+	return r;
 }
 
 type type_composite(type a, type b)
@@ -1047,9 +2106,16 @@ type type_composite(type a, type b)
 		int N = argsa->n;
 		type cargs[N];
 
-		for (int i = 0; i < N; i++)
-			cargs[i] = type_composite(type_unqualified(type_member_type(argsa, i)),
-						  type_unqualified(type_member_type(argsb, i)));
+		for (int i = 0; i < N; i++) {
+
+			type ua = type_unqualified(type_member_type(argsa, i));
+			type ub = type_unqualified(type_member_type(argsb, i));
+
+			cargs[i] = type_composite(ua, ub);
+
+			type_free(ua);
+			type_free(ub);
+		}
 
 		return type_function(type_ref(type_function_return(a)), N, cargs);
 	}
@@ -1058,6 +2124,7 @@ type type_composite(type a, type b)
 	case TC_STRUCT:
 	case TC_UNION:
 	case TC_ATOMIC:
+	case TC_VECTOR:
 	case TC_SELF: break;
 	}
 
@@ -1105,6 +2172,16 @@ bool type_arglist_p(type t)
 	return type_has_class_p(t, TYPE_ARGLIST);
 }
 
+bool type_vector_p(type t)
+{
+	return type_has_class_p(t, TYPE_VECTOR);
+}
+
+bool type_bitint_p(type t)
+{
+	return type_has_class_p(t, TYPE_BITINT);
+}
+
 bool type_enum_p(type t)
 {
 	return type_has_class_p(t, TYPE_ENUM);
@@ -1136,6 +2213,18 @@ int type_array_length(type t)
 	return l;
 }
 
+type type_vector_element(type t)
+{
+	assert(type_vector_p(t));
+	return type_base(t)->element;
+}
+
+int type_vector_lanes(type t)
+{
+	assert(type_vector_p(t));
+	return type_base(t)->length;
+}
+
 type type_function_arguments(type t)
 {
 	assert(type_function_p(t));
@@ -1181,83 +2270,34 @@ int type_bitfield_bits(type t)
 	return t->bits;
 }
 
-type type_int_promotion(type x)
+int type_bitint_width(type t)
 {
-	assert(type_integer_p(x));
-
-	// those do not really exist as types
-	assert(!type_bitfield_p(x));
-
-	type INT = type_basic(TYPE_INT);
-
-	// NOTE: condition is that all values
-	// must be representable, we assume
-	// this is true for smaller rank
-
-	if (type_rank(x) < type_rank(INT)) // rank smaller int
-		return INT;
-
-	if (type_rank(x) == type_rank(INT))
-		return type_signed_p(x) ? INT : type_unsigned(INT);
-
-	return x;
+	assert(type_bitint_p(t));
+	return type_base(t)->width;
 }
 
-
-// 6.3.1.8 Usual arithmetic conversions
-// this determines the common real type
-
-type type_usual_conversion(type a, type b)
+bool type_aligned_p(type t)
 {
-	assert(type_arithmetic_p(a));
-	assert(type_arithmetic_p(b));
-
-	if (type_float_p(a) || type_float_p(b)) {
-
-		enum type_kind T[3] = { TYPE_LONGDOUBLE, TYPE_DOUBLE, TYPE_FLOAT };
-
-		for (int i = 0; i < 3; i++)
-			if (   (T[i] == type_classify(a))
-			    || (T[i] == type_classify(b)))
-				return type_basic(T[i]);
-
-	} else {
-
-		a = type_int_promotion(a);
-		b = type_int_promotion(b);
-
-		if (type_identical_p(a, b))
-			return a;
-
-		if (type_signed_p(a) == type_signed_p(b))
-			return (type_rank(a) >= type_rank(b)) ? a : b;
-
-		if (type_unsigned_p(a) && (type_rank(a) >= type_rank(b)))
-			return a;
-
-		if (type_unsigned_p(b) && (type_rank(b) >= type_rank(a)))
-			return b;
-
-		// FIXME: we assume that an signed type with higher rank
-		// can represent all values of an unsigned type with
-		// lower rank. Bitfields?
-
-		if (type_signed_p(a) && (type_rank(a) > type_rank(b)))
-			return a;
-
-		if (type_signed_p(b) && (type_rank(b) > type_rank(a)))
-			return b;
-
-		if (type_signed_p(a))
-			return type_unsigned(a);
+	return (type_flags(t) & ALIGNED);
+}
 
-		if (type_signed_p(b))
-			return type_unsigned(b);
-	}
+int type_aligned_bytes(type t)
+{
+	assert(type_aligned_p(t));
+	return t->alignment;
+}
 
-	assert(0);
+int type_compound_align(type t)
+{
+	assert(type_compound_p(t));
+	return type_base(t)->align;
 }
 
+bool type_compound_packed_p(type t)
+{
+	assert(type_compound_p(t));
+	return type_base(t)->packed;
+}
 
 static bool type_const_recurse_p(type t)
 {
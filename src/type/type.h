@@ -8,15 +8,17 @@ typedef const struct type* type;
 enum type_kind { TYPE_VOID, TYPE_UNION, TYPE_STRUCT, TYPE_ARRAY, TYPE_POINTER,
 		TYPE_FUNCTION, TYPE_BOOL, TYPE_CHAR, TYPE_ENUM, TYPE_ARGLIST,
 		TYPE_SCHAR, TYPE_SHORT, TYPE_INT, TYPE_LONG, TYPE_LONGLONG,
-		TYPE_FLOAT, TYPE_DOUBLE, TYPE_LONGDOUBLE,
-		TYPE_MODIFIED, TYPE_NR_KINDS };
+		TYPE_FLOAT, TYPE_DOUBLE, TYPE_LONGDOUBLE, TYPE_VECTOR,
+		TYPE_BITINT, TYPE_MODIFIED, TYPE_NR_KINDS };
 
-enum type_category { TC_ARRAY, TC_POINTER, TC_FUNCTION, TC_UNION, TC_STRUCT, TC_ATOMIC, TC_SELF };
+enum type_category { TC_ARRAY, TC_POINTER, TC_FUNCTION, TC_UNION, TC_STRUCT, TC_ATOMIC, TC_VECTOR, TC_SELF };
 
 extern type type_basic(enum type_kind kind);
 extern type type_void(void);
+extern type type_bitint(int N);
 
 extern void type_free(type x);
+extern void type_free_n(int N, const type x[N]);
 extern type type_ref(type x);
 
 struct type_element {
@@ -43,16 +45,24 @@ extern type type_pointer(type t);
 extern type type_function(type ret, int N, type args[static N]);
 extern type type_function2(type ret, int N, type args[static N], const char* argnames[static N]);
 extern type type_struct(const char* tag, int N, struct type_element e[static N]);
+extern type type_struct2(const char* tag, int N, struct type_element e[static N], int align, bool packed);
 extern type type_struct_inc(const char* tag);
 extern type type_union(const char* tag, int N, struct type_element e[static N]);
+extern type type_union2(const char* tag, int N, struct type_element e[static N], int align, bool packed);
 extern type type_union_inc(const char* tag);
 extern type type_array(int N, type t);
 extern type type_incomplete_array(type t);
 extern type type_variable_array(type t, void* targ);
+extern type type_vector(int lanes, type t);
 extern type type_atomic(type t);
 extern type type_enum(const char* tag, int N, struct type_enum list[static N]);
 extern type type_enum_inc(const char* tag);
 
+// completion of incomplete struct, union and enum nodes
+extern void type_complete(type t, int N, struct type_element e[static N]);
+extern void type_complete2(type t, int N, struct type_element e[static N], int align, bool packed);
+extern void type_enum_complete(type t, int N, struct type_enum list[static N]);
+
 // qualifier
 extern type type_unqualified(type t);
 extern type type_const(type t);
@@ -61,6 +71,8 @@ extern type type_restrict(type t);
 extern type type_wide(type t);
 
 extern type type_bitfield(type t, int bits);
+extern type type_bitfield_type(type t);
+extern type type_aligned(type t, int align);
 
 
 // inspection
@@ -74,8 +86,11 @@ extern bool type_union_p(type t);
 extern bool type_array_p(type t);
 extern bool type_enum_p(type t);
 extern bool type_arglist_p(type t);
+extern bool type_vector_p(type t);
+extern bool type_bitint_p(type t);
 extern int type_dependencies(type t);
 extern void* type_get_dependency(type t, int n);
+extern void* const* type_dependency_list(type t, int* n);
 extern int type_rank(type t);
 
 // pointer
@@ -85,6 +100,10 @@ extern type type_pointer_referenced(type t);
 extern type type_array_element(type t);
 extern int type_array_length(type t);
 
+// vector
+extern type type_vector_element(type t);
+extern int type_vector_lanes(type t);
+
 // functions
 extern type type_function_return(type t);
 extern type type_function_arguments(type t);
@@ -95,13 +114,22 @@ extern type type_member_type(type t, int n);
 extern const char* type_member_name(type t, int n);
 extern const char* type_compound_tag(type t);
 extern bool type_struct_has_fam_p(type t);
+extern int type_compound_align(type t);
+extern bool type_compound_packed_p(type t);
 
 extern int type_enum_value(type t, int n);
+extern int type_enum_min(type t);
+extern int type_enum_max(type t);
+extern const char* type_enum_name(type t, int value);
+extern bool type_enum_lookup(type t, const char* name, int* value);
 extern int type_bitfield_bits(type t);
+extern int type_bitint_width(type t);
 
 extern type type_composite(type a, type b);
 
 extern bool type_bitfield_p(type t);
+extern bool type_aligned_p(type t);
+extern int type_aligned_bytes(type t);
 
 extern bool type_complex_p(type t);
 extern bool type_real_p(type t);
@@ -0,0 +1,678 @@
+/* Copyright 2021. Martin Uecker.
+ * All rights reserved. Use of this source code is governed by
+ * a BSD-style license which can be found in the LICENSE file.
+ * */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+#include <stdio.h>
+
+#include "type.h"
+#include "abi.h"
+#include "cache.h"
+
+#include "value.h"
+
+
+// Values are printed (similar to gdb) by interpreting a flat plan
+// which is built once per type. Offsets in the plan are relative
+// to the element of the innermost enclosing loop over an array.
+// Pointers are followed up to the given depth.
+
+enum op_code {
+
+	OP_TEXT, OP_SINT, OP_UINT, OP_BOOL, OP_CHAR, OP_SCHAR, OP_UCHAR,
+	OP_FLOAT, OP_DOUBLE, OP_LDOUBLE, OP_BITS, OP_SBITS, OP_ENUM, OP_UENUM,
+	OP_POINTER, OP_CSTRING, OP_STRING, OP_LOOP, OP_HEX,
+};
+
+struct op {
+
+	enum op_code code;
+	int size;		// bytes, bits, text length, or ops in loop body
+	size_t offset;		// bytes, or into text
+
+	union {
+		type enm;
+		struct type_value_plan* sub;
+		size_t count;
+		struct { int unit; int shift; };	// bit-fields, unit of _BitInt
+	};
+
+	size_t stride;
+};
+
+struct type_value_plan {
+
+	int N;
+	struct op* ops;
+	char* text;
+};
+
+
+static void* xrealloc(void* p, size_t s)
+{
+	p = realloc(p, s);
+
+	if (NULL == p)
+		abort();
+
+	return p;
+}
+
+
+
+struct builder {
+
+	int N;
+	int size;
+	struct op* ops;
+
+	size_t tlen;
+	size_t tsize;
+	char* text;
+};
+
+static struct op* emit(struct builder* b, enum op_code code, int size, size_t offset)
+{
+	if (b->N == b->size) {
+
+		b->size = (0 == b->size) ? 16 : 2 * b->size;
+		b->ops = xrealloc(b->ops, b->size * sizeof(struct op));
+	}
+
+	struct op* op = &b->ops[b->N++];
+
+	*op = (struct op){ .code = code, .size = size, .offset = offset };
+
+	return op;
+}
+
+static void emit_text(struct builder* b, const char* str)
+{
+	size_t len = strlen(str);
+
+	if (b->tlen + len > b->tsize) {
+
+		b->tsize = 2 * (b->tlen + len);
+		b->text = xrealloc(b->text, b->tsize);
+	}
+
+	memcpy(b->text + b->tlen, str, len);
+
+	// adjacent text is merged
+
+	if ((0 < b->N) && (OP_TEXT == b->ops[b->N - 1].code))
+		b->ops[b->N - 1].size += len;
+	else
+		emit(b, OP_TEXT, len, b->tlen);
+
+	b->tlen += len;
+}
+
+
+static void build(struct builder* b, type t, size_t offset, int depth);
+
+static void build_compound(struct builder* b, type t, size_t offset, int depth)
+{
+	if (!type_known_const_size_p(t)) {
+
+		emit_text(b, "<incomplete>");
+		return;
+	}
+
+	emit_text(b, "{");
+
+	int N = type_member_count(t);
+
+	for (int i = 0; i < N; i++) {
+
+		type m = type_member_type(t, i);
+
+		if (0 < i)
+			emit_text(b, ", ");
+
+		emit_text(b, type_member_name(t, i));
+		emit_text(b, " = ");
+
+		if (type_bitfield_p(m)) {
+
+			bool sign = type_signed_p(m) || (type_character_p(m) && (CHAR_MIN < 0));
+
+			struct abi_bitfield_pos pos;
+			type_bitfield_pos(t, i, &pos);
+
+			struct op* op = emit(b, sign ? OP_SBITS : OP_BITS, pos.width, offset + pos.offset);
+			op->unit = pos.size;
+			op->shift = pos.shift;
+			continue;
+		}
+
+		build(b, m, offset + type_offsetof_n(t, i), depth);
+	}
+
+	emit_text(b, "}");
+}
+
+static void build_loop(struct builder* b, type e, int count, size_t offset, int depth)
+{
+	emit_text(b, "{");
+
+	int loop = b->N;
+
+	emit(b, OP_LOOP, 0, offset)->count = count;
+
+	build(b, e, 0, depth);
+
+	b->ops[loop].size = b->N - loop - 1;
+	b->ops[loop].stride = type_sizeof(e);
+
+	emit_text(b, "}");
+}
+
+static void build_array(struct builder* b, type t, size_t offset, int depth)
+{
+	if (!type_known_const_size_p(t)) {
+
+		emit_text(b, "<variable>");
+		return;
+	}
+
+	type e = type_array_element(t);
+
+	if (type_character_p(e)) {
+
+		emit(b, OP_STRING, type_array_length(t), offset);
+		return;
+	}
+
+	build_loop(b, e, type_array_length(t), offset, depth);
+}
+
+static void build_pointer(struct builder* b, type t, size_t offset, int depth)
+{
+	type r = type_pointer_referenced(t);
+
+	if ((0 < depth) && type_character_p(r)) {
+
+		emit(b, OP_CSTRING, 0, offset);
+		return;
+	}
+
+	struct op* op = emit(b, OP_POINTER, 0, offset);
+
+	op->sub = NULL;
+
+	if (   (0 < depth) && !type_function_p(r)
+	    && type_known_const_size_p(r) && (TYPE_VOID != type_classify(r)))
+		op->sub = type_value_plan(r, depth - 1);
+}
+
+static void build_float(struct builder* b, enum type_kind k, size_t offset)
+{
+	switch (k) {
+
+	case TYPE_FLOAT: emit(b, OP_FLOAT, 0, offset); break;
+	case TYPE_DOUBLE: emit(b, OP_DOUBLE, 0, offset); break;
+	case TYPE_LONGDOUBLE: emit(b, OP_LDOUBLE, 0, offset); break;
+	default: assert(0);
+	}
+}
+
+static void build(struct builder* b, type t, size_t offset, int depth)
+{
+	switch (type_classify(t)) {
+
+	case TYPE_STRUCT:
+	case TYPE_UNION:
+		build_compound(b, t, offset, depth);
+		break;
+
+	case TYPE_ARRAY:
+		build_array(b, t, offset, depth);
+		break;
+
+	case TYPE_VECTOR:
+		build_loop(b, type_vector_element(t), type_vector_lanes(t), offset, depth);
+		break;
+
+	case TYPE_BITINT:
+
+		if (type_bitint_width(t) <= 64) {
+
+			struct op* op = emit(b, type_unsigned_p(t) ? OP_BITS : OP_SBITS, type_bitint_width(t), offset);
+			op->unit = type_sizeof(t);
+			op->shift = 0;
+			break;
+		}
+
+		// wider ones are printed in hex (without padding bits)
+
+		emit(b, OP_HEX, type_bitint_width(t), offset)->unit = type_sizeof(t);
+		break;
+
+	case TYPE_POINTER:
+		build_pointer(b, t, offset, depth);
+		break;
+
+	case TYPE_ENUM:
+		emit(b, type_unsigned_p(type_enum_underlying(t)) ? OP_UENUM : OP_ENUM,
+			type_sizeof(t), offset)->enm = type_base(t);
+		break;
+
+	case TYPE_BOOL:
+		emit(b, OP_BOOL, type_sizeof(t), offset);
+		break;
+
+	case TYPE_CHAR:
+		emit(b, type_unsigned_p(t) ? OP_UCHAR : OP_CHAR, 1, offset);
+		break;
+
+	case TYPE_SCHAR:
+		emit(b, type_unsigned_p(t) ? OP_UCHAR : OP_SCHAR, 1, offset);
+		break;
+
+	case TYPE_SHORT:
+	case TYPE_INT:
+	case TYPE_LONG:
+	case TYPE_LONGLONG:
+		emit(b, type_unsigned_p(t) ? OP_UINT : OP_SINT, type_sizeof(t), offset);
+		break;
+
+	case TYPE_FLOAT:
+	case TYPE_DOUBLE:
+	case TYPE_LONGDOUBLE:
+
+		if (type_complex_p(t)) {
+
+			size_t s = type_sizeof(type_real(t));
+
+			build_float(b, type_classify(t), offset);
+			emit_text(b, " + ");
+			build_float(b, type_classify(t), offset + s);
+			emit_text(b, "i");
+			break;
+		}
+
+		build_float(b, type_classify(t), offset);
+		break;
+
+	default:
+		emit_text(b, "<?>");
+		break;
+	}
+}
+
+
+struct type_value_plan* type_value_plan(const struct type* t, int depth)
+{
+	struct builder b = { 0 };
+
+	build(&b, t, 0, depth);
+
+	struct type_value_plan* p = xrealloc(NULL, sizeof(struct type_value_plan));
+
+	p->N = b.N;
+	p->ops = b.ops;
+	p->text = b.text;
+
+	return p;
+}
+
+void type_value_plan_free(struct type_value_plan* p)
+{
+	for (int i = 0; i < p->N; i++)
+		if ((OP_POINTER == p->ops[i].code) && (NULL != p->ops[i].sub))
+			type_value_plan_free(p->ops[i].sub);
+
+	free(p->ops);
+	free(p->text);
+	free(p);
+}
+
+
+
+struct out {
+
+	int n;
+	int l;
+	char* dst;
+};
+
+static void put(struct out* o, const char* str, int len)
+{
+	if (o->l < o->n)
+		memcpy(o->dst + o->l, str, (len < o->n - o->l) ? len : (o->n - o->l));
+
+	o->l += len;
+}
+
+static void put_unsigned(struct out* o, uint64_t v)
+{
+	char buf[20];
+	int i = sizeof(buf);
+
+	do {
+		buf[--i] = '0' + v % 10;
+		v /= 10;
+
+	} while (0 != v);
+
+	put(o, buf + i, sizeof(buf) - i);
+}
+
+static void put_signed(struct out* o, int64_t v)
+{
+	if (v < 0) {
+
+		put(o, "-", 1);
+		put_unsigned(o, -(uint64_t)v);
+		return;
+	}
+
+	put_unsigned(o, v);
+}
+
+static void put_hex(struct out* o, uintptr_t v)
+{
+	char buf[2 + 2 * sizeof(uintptr_t)];
+	int i = sizeof(buf);
+
+	do {
+		buf[--i] = "0123456789abcdef"[v & 15];
+		v >>= 4;
+
+	} while (0 != v);
+
+	buf[--i] = 'x';
+	buf[--i] = '0';
+
+	put(o, buf + i, sizeof(buf) - i);
+}
+
+static void put_char(struct out* o, int c)
+{
+	if ((' ' <= c) && (c <= '~')) {
+
+		if (('\\' == c) || ('"' == c) || ('\'' == c))
+			put(o, "\\", 1);
+
+		char ch = c;
+		put(o, &ch, 1);
+		return;
+	}
+
+	char buf[5] = { '\\', '0' + ((c >> 6) & 3), '0' + ((c >> 3) & 7), '0' + (c & 7), 0 };
+	put(o, buf, 4);
+}
+
+static void put_string(struct out* o, const char* str, size_t max)
+{
+	put(o, "\"", 1);
+
+	for (size_t i = 0; (i < max) && ('\0' != str[i]); i++)
+		put_char(o, (unsigned char)str[i]);
+
+	put(o, "\"", 1);
+}
+
+
+static uint64_t load_unsigned(const char* p, int size)
+{
+	switch (size) {
+
+	case 1: { uint8_t v; memcpy(&v, p, 1); return v; }
+	case 2: { uint16_t v; memcpy(&v, p, 2); return v; }
+	case 4: { uint32_t v; memcpy(&v, p, 4); return v; }
+	case 8: { uint64_t v; memcpy(&v, p, 8); return v; }
+
+	default: {
+
+		// storage units of packed bit-fields
+
+		assert((0 < size) && (size < 8));
+
+		uint64_t v = 0;
+		memcpy((char*)&v + ((__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__) ? 8 - size : 0), p, size);
+		return v;
+	}
+	}
+}
+
+static int64_t load_signed(const char* p, int size)
+{
+	switch (size) {
+
+	case 1: { int8_t v; memcpy(&v, p, 1); return v; }
+	case 2: { int16_t v; memcpy(&v, p, 2); return v; }
+	case 4: { int32_t v; memcpy(&v, p, 4); return v; }
+	case 8: { int64_t v; memcpy(&v, p, 8); return v; }
+	default: assert(0);
+	}
+}
+
+static uint64_t load_bits(const char* p, const struct op* op)
+{
+	uint64_t v = load_unsigned(p, op->unit) >> op->shift;
+
+	return (64 == op->size) ? v : (v & ((UINT64_C(1) << op->size) - 1));
+}
+
+
+static void exec(struct out* o, const struct type_value_plan* p, int start, int end, const char* base);
+
+static void put_value(struct out* o, const struct op* op, const char* base)
+{
+	const char* ptr = base + op->offset;
+	char buf[64];
+
+	switch (op->code) {
+
+	case OP_SINT:
+		put_signed(o, load_signed(ptr, op->size));
+		break;
+
+	case OP_UINT:
+		put_unsigned(o, load_unsigned(ptr, op->size));
+		break;
+
+	case OP_BOOL:
+		if (0 != load_unsigned(ptr, op->size))
+			put(o, "true", 4);
+		else
+			put(o, "false", 5);
+		break;
+
+	case OP_CHAR:
+	case OP_SCHAR:
+	case OP_UCHAR: {
+
+		int c = (OP_UCHAR == op->code) ? *(const unsigned char*)ptr
+			: (OP_SCHAR == op->code) ? *(const signed char*)ptr : *ptr;
+
+		put_signed(o, c);
+		put(o, " '", 2);
+		put_char(o, (unsigned char)c);
+		put(o, "'", 1);
+		break;
+	}
+
+	case OP_FLOAT: {
+
+		float v;
+		memcpy(&v, ptr, sizeof(v));
+		put(o, buf, snprintf(buf, sizeof(buf), "%.9g", v));
+		break;
+	}
+
+	case OP_DOUBLE: {
+
+		double v;
+		memcpy(&v, ptr, sizeof(v));
+		put(o, buf, snprintf(buf, sizeof(buf), "%.17g", v));
+		break;
+	}
+
+	case OP_LDOUBLE: {
+
+		long double v;
+		memcpy(&v, ptr, sizeof(v));
+		put(o, buf, snprintf(buf, sizeof(buf), "%.21Lg", v));
+		break;
+	}
+
+	case OP_BITS:
+		put_unsigned(o, load_bits(ptr, op));
+		break;
+
+	case OP_SBITS: {
+
+		uint64_t v = load_bits(ptr, op);
+
+		if ((op->size < 64) && (v & (UINT64_C(1) << (op->size - 1))))
+			v |= ~UINT64_C(0) << op->size;
+
+		put_signed(o, (int64_t)v);
+		break;
+	}
+
+	case OP_HEX: {
+
+		int nbytes = (op->size + CHAR_BIT - 1) / CHAR_BIT;
+		int size = op->unit;
+		bool lead = true;
+
+		put(o, "0x", 2);
+
+		for (int i = nbytes - 1; i >= 0; i--) {
+
+			unsigned char c = ptr[(__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__) ? (size - 1 - i) : i];
+
+			if ((i == nbytes - 1) && (0 != op->size % CHAR_BIT))
+				c &= (1u << (op->size % CHAR_BIT)) - 1;
+
+			if (lead && (0 == c) && (0 < i))
+				continue;
+
+			put(o, buf, snprintf(buf, sizeof(buf), lead ? "%x" : "%02x", c));
+			lead = false;
+		}
+
+		break;
+	}
+
+	case OP_ENUM:
+	case OP_UENUM: {
+
+		int64_t v = (OP_UENUM == op->code) ? (int64_t)load_unsigned(ptr, op->size) : load_signed(ptr, op->size);
+		const char* name = NULL;
+
+		if ((0 < type_member_count(op->enm)) && (INT_MIN <= v) && (v <= INT_MAX))
+			name = type_enum_name(op->enm, v);
+
+		if (NULL != name)
+			put(o, name, strlen(name));
+		else
+			put_signed(o, v);
+
+		break;
+	}
+
+	case OP_POINTER: {
+
+		const char* q;
+		memcpy(&q, ptr, sizeof(q));
+		put_hex(o, (uintptr_t)q);
+
+		if ((NULL != op->sub) && (NULL != q)) {
+
+			put(o, " -> ", 4);
+			exec(o, op->sub, 0, op->sub->N, q);
+		}
+
+		break;
+	}
+
+	case OP_CSTRING: {
+
+		const char* q;
+		memcpy(&q, ptr, sizeof(q));
+		put_hex(o, (uintptr_t)q);
+
+		if (NULL != q) {
+
+			put(o, " ", 1);
+			put_string(o, q, 200);
+		}
+
+		break;
+	}
+
+	case OP_STRING:
+		put_string(o, ptr, op->size);
+		break;
+
+	case OP_TEXT:
+	case OP_LOOP:
+		assert(0);
+	}
+}
+
+static void exec(struct out* o, const struct type_value_plan* p, int start, int end, const char* base)
+{
+	for (int i = start; i < end; i++) {
+
+		const struct op* op = &p->ops[i];
+
+		switch (op->code) {
+
+		case OP_TEXT:
+			put(o, p->text + op->offset, op->size);
+			break;
+
+		case OP_LOOP:
+
+			for (size_t k = 0; k < op->count; k++) {
+
+				if (0 < k)
+					put(o, ", ", 2);
+
+				exec(o, p, i + 1, i + 1 + op->size, base + op->offset + k * op->stride);
+			}
+
+			i += op->size;
+			break;
+
+		default:
+			put_value(o, op, base);
+			break;
+		}
+	}
+}
+
+
+int type_value_plan_print(int n, char dst[static n], const struct type_value_plan* p, const void* data)
+{
+	struct out o = { n, 0, dst };
+
+	exec(&o, p, 0, p->N, data);
+	put(&o, "", 1);
+
+	return o.l;
+}
+
+// the plan without following pointers is cached in the type
+
+int type_value_print(int n, char dst[static n], const struct type* t, const void* data)
+{
+	struct type_value_plan** p = type_value_cache(t);
+
+	if (NULL == *p)
+		*p = type_value_plan(t, 0);
+
+	return type_value_plan_print(n, dst, *p, data);
+}
+
@@ -0,0 +1,9 @@
+
+struct type;
+struct type_value_plan;
+
+extern struct type_value_plan* type_value_plan(const struct type* t, int depth);
+extern void type_value_plan_free(struct type_value_plan* p);
+extern int type_value_plan_print(int n, char dst[static n], const struct type_value_plan* p, const void* data);
+extern int type_value_print(int n, char dst[static n], const struct type* t, const void* data);
+
@@ -0,0 +1,206 @@
+/* Copyright 2021. Martin Uecker.
+ * All rights reserved. Use of this source code is governed by
+ * a BSD-style license which can be found in the LICENSE file.
+ * */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "type.h"
+
+#include "visit.h"
+
+
+static void* xrealloc(void* p, size_t s)
+{
+	p = realloc(p, s);
+
+	if (NULL == p)
+		abort();
+
+	return p;
+}
+
+
+
+// set of pointers (open addressing, zero is empty)
+
+struct set {
+
+	size_t size;
+	size_t used;
+	uintptr_t* slots;
+};
+
+static size_t set_hash(uintptr_t k)
+{
+	k ^= k >> 17;
+	k *= 0x9E3779B97F4A7C15ull;
+	return k ^ (k >> 29);
+}
+
+static bool set_insert(struct set* s, uintptr_t k)
+{
+	if (2 * (s->used + 1) > s->size) {
+
+		struct set n = { (0 == s->size) ? 64 : 2 * s->size, 0, NULL };
+
+		n.slots = xrealloc(NULL, n.size * sizeof(uintptr_t));
+
+		for (size_t i = 0; i < n.size; i++)
+			n.slots[i] = 0;
+
+		for (size_t i = 0; i < s->size; i++)
+			if (0 != s->slots[i])
+				set_insert(&n, s->slots[i]);
+
+		free(s->slots);
+		*s = n;
+	}
+
+	size_t i = set_hash(k) & (s->size - 1);
+
+	for (; 0 != s->slots[i]; i = (i + 1) & (s->size - 1))
+		if (k == s->slots[i])
+			return false;
+
+	s->slots[i] = k;
+	s->used++;
+
+	return true;
+}
+
+
+
+static int children(type t, unsigned int flags)
+{
+	switch (type_classify(t)) {
+
+	case TYPE_POINTER:
+	case TYPE_ARRAY:
+	case TYPE_VECTOR:
+		return 1;
+
+	case TYPE_FUNCTION:
+		return (flags & TYPE_VISIT_ARGS) ? 2 : 1;
+
+	case TYPE_ARGLIST:
+		return (flags & TYPE_VISIT_ARGS) ? type_member_count(t) : 0;
+
+	case TYPE_STRUCT:
+	case TYPE_UNION:
+		return ((flags & TYPE_VISIT_MEMBERS) && type_complete_p(t)) ? type_member_count(t) : 0;
+
+	default:
+		return 0;
+	}
+}
+
+static type child(type t, int i)
+{
+	switch (type_classify(t)) {
+
+	case TYPE_POINTER:
+		return type_pointer_referenced(t);
+
+	case TYPE_ARRAY:
+		return type_array_element(t);
+
+	case TYPE_VECTOR:
+		return type_vector_element(t);
+
+	case TYPE_FUNCTION:
+		return (0 == i) ? type_function_return(t) : type_function_arguments(t);
+
+	default:
+		return type_member_type(t, i);
+	}
+}
+
+
+struct frame {
+
+	type t;
+	int i;
+	int n;
+};
+
+// Nodes are visited in depth-first pre-order, using an explicit
+// stack. A pre callback returning TYPE_VISIT_SKIP prevents the
+// children of a node from being visited, TYPE_VISIT_STOP ends
+// the traversal. Members of each struct or union are entered only
+// once, which makes the traversal terminate on cyclic graphs.
+// Returns false if the traversal was stopped.
+
+bool type_visit(type t, unsigned int flags,
+		type_visit_f* pre, type_visit_post_f* post, void* ctx)
+{
+	struct set seen = { 0, 0, NULL };
+	size_t size = 16;
+	struct frame* stack = xrealloc(NULL, size * sizeof(struct frame));
+	size_t sp = 0;
+	bool ok = true;
+
+	stack[sp++] = (struct frame){ t, -1, 0 };
+
+	while (0 < sp) {
+
+		struct frame* f = &stack[sp - 1];
+
+		if (-1 == f->i) {
+
+			if (   (flags & TYPE_VISIT_ONCE)
+			    && !set_insert(&seen, (uintptr_t)f->t)) {
+
+				sp--;
+				continue;
+			}
+
+			enum type_visit r = (NULL != pre) ? pre(ctx, f->t) : TYPE_VISIT_CONTINUE;
+
+			if (TYPE_VISIT_STOP == r) {
+
+				ok = false;
+				break;
+			}
+
+			f->i = 0;
+			f->n = (TYPE_VISIT_SKIP == r) ? 0 : children(f->t, flags);
+
+			// low bit tags keys for entered compounds
+
+			if (   (0 < f->n) && type_compound_p(f->t)
+			    && !set_insert(&seen, (uintptr_t)type_base(f->t) | 1))
+				f->n = 0;
+		}
+
+		if (f->i < f->n) {
+
+			type c = child(f->t, f->i++);
+
+			if (NULL == c)
+				continue;
+
+			if (sp == size) {
+
+				size *= 2;
+				stack = xrealloc(stack, size * sizeof(struct frame));
+			}
+
+			stack[sp++] = (struct frame){ c, -1, 0 };
+			continue;
+		}
+
+		if (NULL != post)
+			post(ctx, f->t);
+
+		sp--;
+	}
+
+	free(stack);
+	free(seen.slots);
+
+	return ok;
+}
+
@@ -0,0 +1,17 @@
+
+#include <stdbool.h>
+
+struct type;
+
+enum type_visit { TYPE_VISIT_CONTINUE, TYPE_VISIT_SKIP, TYPE_VISIT_STOP };
+
+#define TYPE_VISIT_ONCE		1	// visit shared nodes only once
+#define TYPE_VISIT_MEMBERS	2	// enter members of structs and unions
+#define TYPE_VISIT_ARGS		4	// enter argument lists of functions
+
+typedef enum type_visit type_visit_f(void* ctx, const struct type* t);
+typedef void type_visit_post_f(void* ctx, const struct type* t);
+
+extern bool type_visit(const struct type* t, unsigned int flags,
+			type_visit_f* pre, type_visit_post_f* post, void* ctx);
+